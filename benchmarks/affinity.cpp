@@ -0,0 +1,280 @@
+/**
+ * @file benchmarks/affinity.cpp
+ * @brief Benchmark of the kernels under several thread placements (OMP_PROC_BIND and OMP_PLACES) and thread counts,
+ * reporting the best configuration of each kernel and shape.
+ *
+ * The OpenMP runtime reads the placement once at startup, so every configuration is measured in a child process
+ * (this same executable run with --child) started with its own environment.
+ * The child also reports where its threads actually run, so that the SMT usage printed with a configuration is the observed
+ * one and not the one expected from the policy (places=cores with more threads than cores does share cores, for instance).
+ */
+
+#include "kernels.hpp"
+#include "matrix_product.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <nanobench.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#	include <omp.h>
+#endif
+#ifdef __linux__
+#	include <sched.h>
+#endif
+
+struct Shape {
+	int m;
+	int n;
+	int k;
+};
+
+constexpr Shape SHAPES[] = {
+    {2000, 2000, 2000},
+    {8192, 32, 512},
+};
+
+// ijk is too slow to be swept over every configuration
+constexpr Kernel SWEPT_KERNELS[] = {Kernel::Reference, Kernel::CacheBlockedI, Kernel::CacheBlockedIJ};
+
+// Block size of the cache blocked kernels
+constexpr int BLOCK_SIZE = 32;
+
+struct Placement {
+	std::string_view bind;	 // OMP_PROC_BIND
+	std::string_view places; // OMP_PLACES
+	std::string_view description;
+};
+
+// Whether the SMT siblings are used depends on the thread count as much as on the policy, so it is observed by the child
+constexpr Placement PLACEMENTS[] = {
+    {"close", "cores", "compact on cores"},
+    {"spread", "cores", "spread over cores and sockets"},
+    {"close", "threads", "compact on hardware threads"},
+    {"spread", "threads", "spread over hardware threads"},
+    {"spread", "sockets", "spread over sockets, free within a socket"},
+    {"false", "threads", "unbound, placed by the OS"},
+};
+
+/**
+ * @brief Reads a single integer of the sysfs CPU topology
+ * @return the value, -1 if it cannot be read
+ */
+auto read_topology(int cpu, std::string_view entry) -> int {
+	std::ifstream file(fmt::format("/sys/devices/system/cpu/cpu{}/topology/{}", cpu, entry));
+	int value = -1;
+	if (!(file >> value)) {
+		return -1;
+	}
+	return value;
+}
+
+/**
+ * @brief Describes where the OpenMP threads of the process run: the hardware threads, cores and sockets they occupy,
+ * and whether some of them share a core (SMT siblings used) or a hardware thread (oversubscribed).
+ *
+ * Unbound threads may migrate, so their placement is the one at the time of the call.
+ */
+auto observed_placement() -> std::string {
+#if defined(_OPENMP) && defined(__linux__)
+	std::vector<int> cpus(omp_get_max_threads(), -1);
+#	pragma omp parallel
+	{
+		cpus[omp_get_thread_num()] = sched_getcpu();
+	}
+
+	std::set<int> hardware_threads;
+	std::set<std::pair<int, int>> cores; // (socket, core)
+	std::set<int> sockets;
+	for (int cpu : cpus) {
+		if (cpu < 0) {
+			return "placement unknown";
+		}
+		int socket = read_topology(cpu, "physical_package_id");
+		int core   = read_topology(cpu, "core_id");
+		if (socket < 0 || core < 0) {
+			return "placement unknown";
+		}
+		hardware_threads.insert(cpu);
+		cores.emplace(socket, core);
+		sockets.insert(socket);
+	}
+
+	auto description = fmt::format("{} threads on {} cores of {} sockets, SMT siblings {}",
+				       cpus.size(),
+				       cores.size(),
+				       sockets.size(),
+				       hardware_threads.size() > cores.size() ? "used" : "idle");
+	if (hardware_threads.size() < cpus.size()) {
+		description += fmt::format(", {} threads sharing a hardware thread", cpus.size() - hardware_threads.size());
+	}
+	return description;
+#else
+	return "placement unknown";
+#endif
+}
+
+/**
+ * @brief Prints the observed placement, then times the kernels on every shape, with the placement of the environment
+ */
+auto run_child() -> void {
+	// Known seed for deterministic RNG
+	srand48(42);
+
+	fmt::println("placement\t{}", observed_placement());
+
+	for (auto const& shape : SHAPES) {
+		RightMatrix A = RightMatrix("A", shape.m, shape.k);
+		LeftMatrix B  = LeftMatrix("B", shape.k, shape.n);
+		RightMatrix C = RightMatrix("C", shape.m, shape.n);
+		matrix_init(A);
+		matrix_init(B);
+		matrix_init(C);
+		double alpha = drand48();
+		double beta  = drand48();
+
+		std::ostringstream oss;
+		ankerl::nanobench::Bench bench;
+		bench.epochs(3).output(&oss);
+		for (auto kernel : SWEPT_KERNELS) {
+			bench.run(fmt::format("{} | {}x{}x{}", kernel_label(kernel, BLOCK_SIZE), shape.m, shape.n, shape.k),
+				  [&]() { kernel_run(kernel, alpha, A, B, beta, C, BLOCK_SIZE); });
+		}
+		bench.doNotOptimizeAway(A).doNotOptimizeAway(B).doNotOptimizeAway(C).doNotOptimizeAway(alpha).doNotOptimizeAway(beta);
+
+		for (auto const& res : bench.results()) {
+			auto measure = res.fromString("elapsed");
+			fmt::println("{}\t{}\t{}\t{}",
+				     res.config().mBenchmarkName,
+				     res.minimum(measure),
+				     res.maximum(measure),
+				     res.median(measure));
+		}
+		std::fflush(stdout);
+	}
+}
+
+struct Timing {
+	double min;
+	double max;
+	double med;
+};
+
+struct Measurement {
+	std::string placement; // Observed by the child
+	std::map<std::string, Timing> timings;
+};
+
+/**
+ * @brief Runs the child process with a placement and a number of threads
+ * @return the observed placement and the timings by "kernel | shape", no timings if the child failed
+ */
+auto run_configuration(std::string const& executable, Placement const& placement, unsigned threads) -> Measurement {
+	auto command = fmt::format("OMP_PROC_BIND={} OMP_PLACES={} OMP_NUM_THREADS={} '{}' --child --kokkos-num-threads={}",
+				   placement.bind,
+				   placement.places,
+				   threads,
+				   executable,
+				   threads);
+	Measurement measurement{"placement unknown", {}};
+	FILE* child = popen(command.c_str(), "r");
+	if (child == nullptr) {
+		return measurement;
+	}
+
+	char line[512];
+	while (std::fgets(line, sizeof(line), child) != nullptr) {
+		std::istringstream fields(line);
+		std::string name;
+		Timing timing{};
+		if (!std::getline(fields, name, '\t')) {
+			continue;
+		}
+		if (name == "placement") {
+			std::getline(fields, measurement.placement);
+		}
+		else if (fields >> timing.min >> timing.max >> timing.med) {
+			measurement.timings[name] = timing;
+		}
+	}
+	if (pclose(child) != 0) {
+		fmt::println(stderr, "{} failed", command);
+		measurement.timings.clear();
+	}
+	return measurement;
+}
+
+/**
+ * @brief 1, 2, 4, ... threads, up to and including the number of hardware threads
+ */
+auto thread_counts() -> std::vector<unsigned> {
+	unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> counts;
+	for (unsigned threads = 1; threads < max_threads; threads *= 2) {
+		counts.push_back(threads);
+	}
+	counts.push_back(max_threads);
+	return counts;
+}
+
+auto main(int argc, char* argv[]) -> int {
+	if (argc > 1 && std::string_view(argv[1]) == "--child") {
+		Kokkos::initialize(argc, argv);
+		run_child();
+		Kokkos::finalize();
+		exit(EXIT_SUCCESS);
+	}
+
+	auto executable = std::filesystem::read_symlink("/proc/self/exe").string();
+
+	struct Best {
+		Timing timing;
+		std::string configuration;
+	};
+	std::map<std::string, Best> best;
+
+	for (auto const& placement : PLACEMENTS) {
+		for (unsigned threads : thread_counts()) {
+			auto configuration = fmt::format("bind={} places={} threads={}", placement.bind, placement.places, threads);
+			auto measurement   = run_configuration(executable, placement, threads);
+			fmt::println("{}: {}", configuration, measurement.placement);
+			for (auto const& [name, timing] : measurement.timings) {
+				fmt::println("{} | {}, Min: {}s, Max: {}s, Med: {}s",
+					     name,
+					     configuration,
+					     timing.min,
+					     timing.max,
+					     timing.med);
+				auto found = best.find(name);
+				if (found == best.end() || timing.med < found->second.timing.med) {
+					best[name] = Best{
+					    timing,
+					    fmt::format("{} ({}; {})", configuration, placement.description, measurement.placement),
+					};
+				}
+			}
+		}
+	}
+
+	fmt::println("");
+	fmt::println("Best configuration of each kernel and shape:");
+	for (auto const& [name, entry] : best) {
+		fmt::println("{}: {}, Med: {}s", name, entry.configuration, entry.timing.med);
+	}
+
+	exit(EXIT_SUCCESS);
+}
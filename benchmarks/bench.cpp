@@ -0,0 +1,363 @@
+/**
+ * @file benchmarks/bench.cpp
+ * @brief Benchmark driver where the kernels, shapes, layouts and output format are selected from the command line.
+ *
+ * Example:
+ *   ./build/benchmarks/top.bench --kernel=reference,ij --m=4000 --n=500 --k=2000 --block-size=8,32 --format=json
+ */
+
+#include "cache_model.hpp"
+#include "kernels.hpp"
+#include "matrix_product.hpp"
+#include "perf_counters.hpp"
+#include "regression_gate.hpp"
+#include "roofline.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <nanobench.h>
+
+#include <filesystem>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct BenchConfig {
+	std::vector<Kernel> kernels  = {Kernel::Reference};
+	int m			     = 2000;
+	int n			     = 2000;
+	int k			     = 2000;
+	std::string layout	     = "rlr"; // Layouts of A, B and C, r for right and l for left
+	std::vector<int> block_sizes = {}; // Empty for the block size of the cache model
+	int threads		     = 0; // 0 to let Kokkos decide
+	int repetitions		     = 5;
+	std::string format	     = "text";
+	bool counters		     = true; // Hardware counters in the text output
+	std::string baseline;		     // Baseline file to compare against, empty for none
+	std::string save_baseline;	     // Baseline file to update with the results, empty for none
+	double threshold	     = 0.05; // Tolerated relative slowdown over the baseline
+	long seed		     = 42;
+};
+
+constexpr auto USAGE = R"(Usage: top.bench [options] [kokkos options]
+  --kernel=LIST        Comma separated kernels among reference, i, ij, ijk, tiles, and cblas when built with a CBLAS
+                       (default: reference)
+  --m=M --n=N --k=K    Dimensions of the product, A is m x k and B is k x n (default: 2000)
+  --size=S             Sets m, n and k to S
+  --layout=XYZ         Layouts of A, B and C, r for LayoutRight and l for LayoutLeft (default: rlr)
+  --block-size=LIST    Comma separated block sizes for the cache blocked kernels (default: from the cache model)
+  --threads=T          Number of threads, forwarded to Kokkos (default: Kokkos' choice)
+  --repetitions=R      Number of epochs measured per kernel (default: 5)
+  --format=FORMAT      Output format among text, json and csv (default: text)
+  --counters=on|off    Hardware counters of an extra call of each kernel in the text output (default: on)
+  --seed=S             Seed of the matrix generation (default: 42)
+  --baseline=FILE      Compares the results against a baseline file, and fails on a significant regression
+  --threshold=T        Relative slowdown tolerated by --baseline, non-negative, 0.05 for 5% (default: 0.05)
+  --save-baseline=FILE Adds the results to a baseline file, replacing the entries of the same shape, threads and kernel.
+                       It must not be the file of --baseline
+  --help               Prints this message
+)";
+
+[[noreturn]] auto usage_error(std::string_view message) -> void {
+	fmt::println(stderr, "{}\n{}", message, USAGE);
+	exit(EXIT_FAILURE);
+}
+
+template <class T> auto parse_number(std::string_view option, std::string_view value) -> T {
+	T number{};
+	auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), number);
+	if (error != std::errc() || end != value.data() + value.size()) {
+		usage_error(fmt::format("Invalid value '{}' for {}", value, option));
+	}
+	return number;
+}
+
+auto split_list(std::string_view list) -> std::vector<std::string_view> {
+	std::vector<std::string_view> items;
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t end = list.find(',', start);
+		if (end == std::string_view::npos) {
+			end = list.size();
+		}
+		items.push_back(list.substr(start, end - start));
+		start = end + 1;
+	}
+	return items;
+}
+
+/**
+ * @brief Whether two paths name the same file, even if it does not exist yet
+ */
+auto same_file(std::string const& lhs, std::string const& rhs) -> bool {
+	std::error_code error;
+	auto lhs_path = std::filesystem::weakly_canonical(lhs, error);
+	auto rhs_path = error ? std::filesystem::path() : std::filesystem::weakly_canonical(rhs, error);
+	if (error) {
+		return std::filesystem::path(lhs).lexically_normal() == std::filesystem::path(rhs).lexically_normal();
+	}
+	return lhs_path == rhs_path;
+}
+
+/**
+ * @brief Parses the options of the driver. Unknown options are left in kokkos_args to be forwarded to Kokkos.
+ */
+auto parse_args(int argc, char* argv[], std::vector<std::string>& kokkos_args) -> BenchConfig {
+	BenchConfig config;
+	for (int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+		if (arg == "--help") {
+			fmt::print("{}", USAGE);
+			exit(EXIT_SUCCESS);
+		}
+
+		size_t equal = arg.find('=');
+		if (!arg.starts_with("--") || equal == std::string_view::npos) {
+			kokkos_args.emplace_back(arg);
+			continue;
+		}
+		std::string_view option = arg.substr(0, equal);
+		std::string_view value	= arg.substr(equal + 1);
+
+		if (option == "--kernel") {
+			config.kernels.clear();
+			for (auto name : split_list(value)) {
+				auto kernel = kernel_from_name(name);
+				if (!kernel) {
+					usage_error(fmt::format("Unknown kernel '{}'", name));
+				}
+				config.kernels.push_back(*kernel);
+			}
+		}
+		else if (option == "--m") {
+			config.m = parse_number<int>(option, value);
+		}
+		else if (option == "--n") {
+			config.n = parse_number<int>(option, value);
+		}
+		else if (option == "--k") {
+			config.k = parse_number<int>(option, value);
+		}
+		else if (option == "--size") {
+			config.m = config.n = config.k = parse_number<int>(option, value);
+		}
+		else if (option == "--layout") {
+			if (value.size() != 3 || value.find_first_not_of("rl") != std::string_view::npos) {
+				usage_error(fmt::format("Invalid layout '{}'", value));
+			}
+			config.layout = value;
+		}
+		else if (option == "--block-size") {
+			config.block_sizes.clear();
+			for (auto block_size : split_list(value)) {
+				config.block_sizes.push_back(parse_number<int>(option, block_size));
+			}
+		}
+		else if (option == "--threads") {
+			config.threads = parse_number<int>(option, value);
+		}
+		else if (option == "--repetitions") {
+			config.repetitions = parse_number<int>(option, value);
+		}
+		else if (option == "--format") {
+			if (value != "text" && value != "json" && value != "csv") {
+				usage_error(fmt::format("Unknown format '{}'", value));
+			}
+			config.format = value;
+		}
+		else if (option == "--counters") {
+			if (value != "on" && value != "off") {
+				usage_error(fmt::format("Invalid value '{}' for {}", value, option));
+			}
+			config.counters = value == "on";
+		}
+		else if (option == "--seed") {
+			config.seed = parse_number<long>(option, value);
+		}
+		else if (option == "--baseline") {
+			config.baseline = value;
+		}
+		else if (option == "--threshold") {
+			config.threshold = parse_number<double>(option, value);
+		}
+		else if (option == "--save-baseline") {
+			config.save_baseline = value;
+		}
+		else {
+			kokkos_args.emplace_back(arg);
+		}
+	}
+
+	if (config.m <= 0 || config.n <= 0 || config.k <= 0 || config.repetitions <= 0) {
+		usage_error("Dimensions and repetitions must be positive");
+	}
+	for (auto block_size : config.block_sizes) {
+		if (block_size <= 0) {
+			usage_error("Block sizes must be positive");
+		}
+	}
+	if (config.block_sizes.empty()) {
+		config.block_sizes.push_back(model_block_size(read_cache_hierarchy(), config.k));
+	}
+	if (!std::isfinite(config.threshold) || config.threshold < 0.0) {
+		usage_error("The threshold must be a non-negative number");
+	}
+	// The results are saved before being compared, so the gate would compare them with themselves
+	if (!config.baseline.empty() && !config.save_baseline.empty() && same_file(config.baseline, config.save_baseline)) {
+		usage_error("--baseline and --save-baseline must be different files");
+	}
+	return config;
+}
+
+/**
+ * @brief Runs the selected kernels on matrices of the given layouts.
+ * If counters is not null, each kernel is called once more to count its hardware events, in the order of the runs.
+ */
+template <class ALayout, class BLayout, class CLayout>
+auto run_benchmarks(BenchConfig const& config, ankerl::nanobench::Bench& bench, PerfCounters* counters, std::vector<PerfSample>& samples)
+    -> void {
+	using AMatrixType = Kokkos::View<double**, ALayout>;
+	using BMatrixType = Kokkos::View<double**, BLayout>;
+	using CMatrixType = Kokkos::View<double**, CLayout>;
+
+	srand48(config.seed);
+
+	// Generate A, B, C
+	AMatrixType A = AMatrixType("A", config.m, config.k);
+	BMatrixType B = BMatrixType("B", config.k, config.n);
+	CMatrixType C = CMatrixType("C", config.m, config.n);
+	matrix_init(A);
+	matrix_init(B);
+	matrix_init(C);
+
+	// Generate alpha and beta
+	double alpha = drand48();
+	double beta  = drand48();
+
+	auto run = [&](Kernel kernel, int block_size) {
+		auto product = [&]() { kernel_run(kernel, alpha, A, B, beta, C, block_size); };
+		bench.run(kernel_label(kernel, block_size), product);
+		if (counters != nullptr) {
+			samples.push_back(counters->count(product));
+		}
+	};
+
+	for (auto kernel : config.kernels) {
+		if (!kernel_info(kernel).blocked) {
+			run(kernel, 0);
+			continue;
+		}
+		for (auto block_size : config.block_sizes) {
+			run(kernel, block_size);
+		}
+	}
+
+	bench.doNotOptimizeAway(A).doNotOptimizeAway(B).doNotOptimizeAway(C).doNotOptimizeAway(alpha).doNotOptimizeAway(beta);
+}
+
+auto run_with_layout(BenchConfig const& config, ankerl::nanobench::Bench& bench, PerfCounters* counters, std::vector<PerfSample>& samples)
+    -> void {
+	using Kokkos::LayoutLeft;
+	using Kokkos::LayoutRight;
+
+	auto const& layout = config.layout;
+	if (layout == "rrr") {
+		run_benchmarks<LayoutRight, LayoutRight, LayoutRight>(config, bench, counters, samples);
+	}
+	else if (layout == "rrl") {
+		run_benchmarks<LayoutRight, LayoutRight, LayoutLeft>(config, bench, counters, samples);
+	}
+	else if (layout == "rlr") {
+		run_benchmarks<LayoutRight, LayoutLeft, LayoutRight>(config, bench, counters, samples);
+	}
+	else if (layout == "rll") {
+		run_benchmarks<LayoutRight, LayoutLeft, LayoutLeft>(config, bench, counters, samples);
+	}
+	else if (layout == "lrr") {
+		run_benchmarks<LayoutLeft, LayoutRight, LayoutRight>(config, bench, counters, samples);
+	}
+	else if (layout == "lrl") {
+		run_benchmarks<LayoutLeft, LayoutRight, LayoutLeft>(config, bench, counters, samples);
+	}
+	else if (layout == "llr") {
+		run_benchmarks<LayoutLeft, LayoutLeft, LayoutRight>(config, bench, counters, samples);
+	}
+	else {
+		run_benchmarks<LayoutLeft, LayoutLeft, LayoutLeft>(config, bench, counters, samples);
+	}
+}
+
+auto main(int argc, char* argv[]) -> int {
+	std::vector<std::string> kokkos_args = {argv[0]};
+	BenchConfig config		     = parse_args(argc, argv, kokkos_args);
+	if (config.threads > 0) {
+		kokkos_args.push_back(fmt::format("--kokkos-num-threads={}", config.threads));
+	}
+
+	std::vector<char*> kokkos_argv;
+	for (auto& arg : kokkos_args) {
+		kokkos_argv.push_back(arg.data());
+	}
+	int kokkos_argc = int(kokkos_argv.size());
+	Kokkos::initialize(kokkos_argc, kokkos_argv.data());
+
+	// Work of the product and bounds of the machine
+	ProductCost cost  = product_cost(config.m, config.n, config.k);
+	Roofline roofline = measure_roofline();
+
+	// One batch is one product, so that the JSON and CSV outputs can be turned into flop/s
+	std::ostringstream oss;
+	ankerl::nanobench::Bench bench;
+	bench.title(fmt::format("m={} n={} k={} layout={}", config.m, config.n, config.k, config.layout))
+	    .unit("flop")
+	    .batch(cost.flops)
+	    .epochs(config.repetitions)
+	    .performanceCounters(true)
+	    .output(&oss);
+
+	// Counters are only shown in the text output
+	std::optional<PerfCounters> counters;
+	if (config.counters && config.format == "text") {
+		counters.emplace();
+	}
+	std::vector<PerfSample> samples;
+	run_with_layout(config, bench, counters ? &*counters : nullptr, samples);
+
+	if (config.format == "json") {
+		ankerl::nanobench::render(ankerl::nanobench::templates::json(), bench, std::cout);
+	}
+	else if (config.format == "csv") {
+		ankerl::nanobench::render(ankerl::nanobench::templates::csv(), bench, std::cout);
+	}
+	else {
+		auto const& results = bench.results();
+		for (size_t i = 0; i < results.size(); i++) {
+			print_result(results[i], cost, roofline, i < samples.size() ? format_sample(samples[i]) : "");
+		}
+	}
+
+	int threads = Kokkos::DefaultExecutionSpace().concurrency();
+	if (!config.save_baseline.empty()) {
+		Baseline baseline = load_baseline(config.save_baseline);
+		for (auto const& res : bench.results()) {
+			baseline[baseline_key(res, threads)] = baseline_entry(res);
+		}
+		if (!save_baseline(config.save_baseline, baseline)) {
+			fmt::println(stderr, "Could not write the baseline to {}", config.save_baseline);
+		}
+	}
+
+	bool passed = true;
+	if (!config.baseline.empty()) {
+		passed = check_against_baseline(load_baseline(config.baseline), bench, config.threshold, threads);
+	}
+
+	Kokkos::finalize();
+	exit(passed ? EXIT_SUCCESS : EXIT_FAILURE);
+}
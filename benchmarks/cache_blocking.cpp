@@ -4,6 +4,9 @@
  */
 
 #include "matrix_product.hpp"
+#include "matrix_product_cblas.hpp"
+#include "perf_counters.hpp"
+#include "roofline.hpp"
 
 #include <Kokkos_Core.hpp>
 #include <cstdlib>
@@ -23,6 +26,13 @@ auto main(int argc, char* argv[]) -> int {
 	int n = 2000;
 	int k = 2000;
 
+	// Work of the product and bounds of the machine
+	ProductCost cost  = product_cost(m, n, k);
+	Roofline roofline = measure_roofline();
+
+	// Hardware counters of one extra call of each kernel, so that they do not disturb the timings
+	PerfCounters counters;
+
 	// Generate A, B, C
 	RightMatrix A = RightMatrix("A", m, k);
 	LeftMatrix B  = LeftMatrix("B", k, n);
@@ -48,11 +58,29 @@ auto main(int argc, char* argv[]) -> int {
 			     .doNotOptimizeAway(alpha)
 			     .doNotOptimizeAway(beta)
 			     .results();
+	auto reference_sample = counters.count([&]() { matrix_product_reference(alpha, A, B, beta, C); });
 	for (auto const& res : reference) {
-		auto measure = res.fromString("elapsed");
-		auto name    = res.config().mBenchmarkName;
-		fmt::println("{}, Min: {}s, Max: {}s, Med: {}s", name, res.minimum(measure), res.maximum(measure), res.median(measure));
+		print_result(res, cost, roofline, format_sample(reference_sample));
+	}
+
+#ifdef TOP_HAVE_CBLAS
+	// Vendor BLAS as a baseline
+	auto cblas = ankerl::nanobench::Bench()
+			 .epochs(5)
+			 .performanceCounters(true)
+			 .output(&oss)
+			 .run("CBLAS", [&]() { matrix_product_cblas(alpha, A, B, beta, C); })
+			 .doNotOptimizeAway(A)
+			 .doNotOptimizeAway(B)
+			 .doNotOptimizeAway(C)
+			 .doNotOptimizeAway(alpha)
+			 .doNotOptimizeAway(beta)
+			 .results();
+	auto cblas_sample = counters.count([&]() { matrix_product_cblas(alpha, A, B, beta, C); });
+	for (auto const& res : cblas) {
+		print_result(res, cost, roofline, format_sample(cblas_sample));
 	}
+#endif
 
 	// Cache blocking
 	constexpr int block_sizes[] = {4, 8, 16, 32, 64, 128};
@@ -73,11 +101,13 @@ auto main(int argc, char* argv[]) -> int {
 				  .doNotOptimizeAway(alpha)
 				  .doNotOptimizeAway(beta)
 				  .results();
-		for (auto const& res : result) {
-			auto measure = res.fromString("elapsed");
-			auto name    = res.config().mBenchmarkName;
-			fmt::println(
-			    "{}, Min: {}s, Max: {}s, Med: {}s", name, res.minimum(measure), res.maximum(measure), res.median(measure));
+		// Same order as the runs
+		PerfSample samples[] = {
+		    counters.count([&]() { matrix_product_cache_blocked_i(alpha, A, B, beta, C, block_size); }),
+		    counters.count([&]() { matrix_product_cache_blocked_ij(alpha, A, B, beta, C, block_size); }),
+		};
+		for (size_t i = 0; i < result.size(); i++) {
+			print_result(result[i], cost, roofline, format_sample(samples[i]));
 		}
 	}
 
@@ -0,0 +1,136 @@
+/**
+ * @file benchmarks/cache_model.cpp
+ * @brief Validation of the cache model: the block and tile sizes it derives from sysfs are compared with the best
+ * sizes of an empirical sweep.
+ */
+
+#include "cache_model.hpp"
+#include "matrix_product.hpp"
+#include "roofline.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <nanobench.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Median time of a run, in seconds
+ */
+auto median_time(ankerl::nanobench::Result const& res) -> double {
+	return res.median(res.fromString("elapsed"));
+}
+
+/**
+ * @brief Prints how far the model is from the best of the sweep
+ */
+auto report(std::vector<ankerl::nanobench::Result> const& results, size_t model_index) -> void {
+	size_t best = 0;
+	for (size_t i = 1; i < results.size(); i++) {
+		if (median_time(results[i]) < median_time(results[best])) {
+			best = i;
+		}
+	}
+	double model_time = median_time(results[model_index]);
+	double best_time  = median_time(results[best]);
+	fmt::println("Model: {} ({}s), empirical best: {} ({}s), model is {:.1f}% slower than the best",
+		     results[model_index].config().mBenchmarkName,
+		     model_time,
+		     results[best].config().mBenchmarkName,
+		     best_time,
+		     100.0 * (model_time / best_time - 1.0));
+}
+
+auto main(int argc, char* argv[]) -> int {
+	Kokkos::initialize(argc, argv);
+
+	// Known seed for deterministic RNG
+	srand48(42);
+
+	// Dimensions of the matrices
+	int m = 2000;
+	int n = 2000;
+	int k = 2000;
+
+	// Work of the product and bounds of the machine
+	ProductCost cost  = product_cost(m, n, k);
+	Roofline roofline = measure_roofline();
+
+	// What the model sees and chooses
+	CacheHierarchy caches = read_cache_hierarchy();
+	for (auto [name, cache] : {std::pair{"L1d", caches.l1d}, std::pair{"L2", caches.l2}, std::pair{"L3", caches.l3}}) {
+		fmt::println("{}: {} KiB, {}-way, {} B lines, shared by {} CPUs, {} KiB usable per thread",
+			     name,
+			     cache.size >> 10,
+			     cache.ways,
+			     cache.line_size,
+			     cache.shared_cpus,
+			     usable_cache_size(cache) >> 10);
+	}
+	int threads	= Kokkos::DefaultExecutionSpace().concurrency();
+	int block_size	= model_block_size(caches, k);
+	TileSizes tiles = model_tile_sizes(caches, m, threads);
+	fmt::println("Model block size: {}, model tiles: mc={} nc={} kc={}", block_size, tiles.mc, tiles.nc, tiles.kc);
+
+	// Generate A, B, C
+	RightMatrix A = RightMatrix("A", m, k);
+	LeftMatrix B  = LeftMatrix("B", k, n);
+	RightMatrix C = RightMatrix("C", m, n);
+	matrix_init(A);
+	matrix_init(B);
+	matrix_init(C);
+
+	// Generate alpha and beta
+	double alpha = drand48();
+	double beta  = drand48();
+
+	// Square blocks of the ij kernel, the model first and then the sweep of cache_blocking.cpp
+	{
+		std::ostringstream oss;
+		ankerl::nanobench::Bench bench;
+		bench.epochs(3).performanceCounters(true).output(&oss);
+		bench.run(fmt::format("Cache Blocked ij{} (model)", block_size),
+			  [&]() { matrix_product_cache_blocked_ij(alpha, A, B, beta, C, block_size); });
+		for (int swept : {4, 8, 16, 32, 64, 128}) {
+			bench.run(fmt::format("Cache Blocked ij{}", swept), [&]() { matrix_product_cache_blocked_ij(alpha, A, B, beta, C, swept); });
+		}
+		bench.doNotOptimizeAway(A).doNotOptimizeAway(B).doNotOptimizeAway(C).doNotOptimizeAway(alpha).doNotOptimizeAway(beta);
+		for (auto const& res : bench.results()) {
+			print_result(res, cost, roofline);
+		}
+		report(bench.results(), 0);
+	}
+
+	// Tiles, the model first and then each tile size halved and doubled
+	{
+		std::vector<TileSizes> variants = {tiles};
+		for (int scale : {-1, 1}) {
+			auto scaled = [&](int size) { return std::max(8, scale < 0 ? size / 2 : size * 2); };
+			variants.push_back(TileSizes{scaled(tiles.mc), tiles.nc, tiles.kc});
+			variants.push_back(TileSizes{tiles.mc, scaled(tiles.nc), tiles.kc});
+			variants.push_back(TileSizes{tiles.mc, tiles.nc, scaled(tiles.kc)});
+		}
+
+		std::ostringstream oss;
+		ankerl::nanobench::Bench bench;
+		bench.epochs(3).performanceCounters(true).output(&oss);
+		for (size_t i = 0; i < variants.size(); i++) {
+			auto const& variant = variants[i];
+			bench.run(fmt::format("Cache Blocked tiles mc={} nc={} kc={}{}", variant.mc, variant.nc, variant.kc, i == 0 ? " (model)" : ""),
+				  [&]() { matrix_product_cache_blocked_tiles(alpha, A, B, beta, C, variant); });
+		}
+		bench.doNotOptimizeAway(A).doNotOptimizeAway(B).doNotOptimizeAway(C).doNotOptimizeAway(alpha).doNotOptimizeAway(beta);
+		for (auto const& res : bench.results()) {
+			print_result(res, cost, roofline);
+		}
+		report(bench.results(), 0);
+	}
+
+	Kokkos::finalize();
+	exit(EXIT_SUCCESS);
+}
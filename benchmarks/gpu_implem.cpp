@@ -4,6 +4,7 @@
  */
 
 #include "matrix_product.hpp"
+#include "roofline.hpp"
 
 #include <Kokkos_Core.hpp>
 #include <cstdlib>
@@ -11,8 +12,102 @@
 #include <nanobench.h>
 
 #include "culkan.h"
+#include "matrix_product_gpu.hpp"
+#include "shaders.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <optional>
+#include <string>
+
+// Products of a batch, submitted one by one or all at once in a sequence
+constexpr int BATCH_SIZE = 8;
+
+/**
+ * @brief Time to create an instance and set it up, which compiles the shader unless it is in the pipeline cache file
+ * @return the time in seconds, the instance is destroyed afterwards, which saves its pipeline cache
+ */
+auto startup_time(uint32_t const* spirv, size_t spirv_size, CulkanInvocations invocations) -> double {
+	CulkanBinding bindings[] = {
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	};
+	CulkanLayout layout = {
+	    .bindingCount		 = 3,
+	    .bindings			 = bindings,
+	    .pushConstantSize		 = sizeof(OperationScalars),
+	    .specializationConstants	 = nullptr,
+	    .specializationConstantCount = 0,
+	    .requiredSubgroupSize	 = 0,
+	};
+
+	Kokkos::Timer timer;
+	Culkan* culkan = culkanInitFromMemory(&layout, spirv, spirv_size, invocations);
+	culkanSetup(culkan);
+	double time = timer.seconds();
+	culkanDestroy(culkan);
+	return time;
+}
+
+/**
+ * @brief Sets an environment variable for its lifetime, then restores its previous value, or unsets it if it had none
+ */
+class ScopedEnv {
+      public:
+	ScopedEnv(char const* name, char const* value) : name(name) {
+		if (char const* previous_value = getenv(name)) {
+			previous = previous_value;
+		}
+		setenv(name, value, 1);
+	}
+
+	ScopedEnv(ScopedEnv const&)			= delete;
+	auto operator=(ScopedEnv const&) -> ScopedEnv& = delete;
+
+	~ScopedEnv() {
+		if (previous) {
+			setenv(name, previous->c_str(), 1);
+		}
+		else {
+			unsetenv(name);
+		}
+	}
+
+      private:
+	char const* name;
+	std::optional<std::string> previous;
+};
+
+/**
+ * @brief Startup latency of the shaders without (cold) and with (warm) the pipeline cache file of a previous instance
+ */
+auto report_startup() -> void {
+	// A directory of our own, emptied for the cold start, and no Mesa disk cache, which would warm the cold start up.
+	// Both only for this measure, the contexts of the benchmarks below use the cache of the user.
+	auto cache_dir = std::filesystem::temp_directory_path() / "top_gpu_implem_pipeline_cache";
+	ScopedEnv cache_dir_env("CULKAN_PIPELINE_CACHE_DIR", cache_dir.c_str());
+	ScopedEnv mesa_cache_env("MESA_SHADER_CACHE_DISABLE", "true");
+
+	struct {
+		char const* name;
+		uint32_t const* spirv;
+		size_t spirv_size;
+		CulkanInvocations invocations;
+	} const shaders[] = {
+	    {"operation", OPERATION_SPV, sizeof(OPERATION_SPV), {1024, 1, 1}},
+	    {"operation_tiled", OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV), {16, 16, 1}},
+	};
+	for (auto const& shader : shaders) {
+		std::filesystem::remove_all(cache_dir);
+		double cold = startup_time(shader.spirv, shader.spirv_size, shader.invocations);
+		double warm = startup_time(shader.spirv, shader.spirv_size, shader.invocations);
+		fmt::println("Startup of {}: cold {:.3f}ms, warm {:.3f}ms (pipeline cache file)", shader.name, cold * 1e3, warm * 1e3);
+	}
+	std::filesystem::remove_all(cache_dir);
+}
 
 auto main(int argc, char* argv[]) -> int {
 	Kokkos::initialize(argc, argv);
@@ -20,6 +115,11 @@ auto main(int argc, char* argv[]) -> int {
 	// Known seed for deterministic RNG
 	srand48(42);
 
+	report_startup();
+
+	// Bounds of the CPU, the GPU results are also reported against it
+	Roofline roofline = measure_roofline();
+
 	// Dimensions of the matrices
 	constexpr int matrix_sizes[] = {
 	    250,
@@ -28,11 +128,39 @@ auto main(int argc, char* argv[]) -> int {
 	    2000,
 	};
 
+	// One context for the whole sweep, whose memory pool holds the buffers of all the instances.
+	// The instance of operation.comp is set up once and its bindings are resized from a size to the next.
+	CulkanContext* context	 = culkanCreateContext();
+	CulkanBinding bindings[] = {
+	    // Binding for A
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	    // Binding for B
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	    // Binding for C
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	};
+	CulkanLayout layout = {
+	    .bindingCount		 = 3,
+	    .bindings			 = bindings,
+	    .pushConstantSize		 = sizeof(OperationScalars),
+	    .specializationConstants	 = nullptr,
+	    .specializationConstantCount = 0,
+	    .requiredSubgroupSize	 = 0,
+	};
+
+	// The shader is compiled at build time and embedded in the binary
+	Culkan* culkan = culkanInitWithContext(context, &layout, OPERATION_SPV, sizeof(OPERATION_SPV), (CulkanInvocations){1024, 1, 1});
+
+	// The pipeline is built once, the runs only submit the command buffer
+	culkanSetup(culkan);
+
 	for (const auto& size : matrix_sizes) {
 		int m = size;
 		int n = size;
 		int k = size;
 
+		ProductCost cost = product_cost(m, n, k);
+
 		RightMatrix A = RightMatrix("A", m, k);
 		LeftMatrix B  = LeftMatrix("B", k, n);
 		RightMatrix C = RightMatrix("C", m, n);
@@ -44,35 +172,21 @@ auto main(int argc, char* argv[]) -> int {
 		double alpha = drand48();
 		double beta  = drand48();
 
-		// Bindings of the shader
-		CulkanBinding bindings[] = {
-		    // Binding for n
-		    {.size = sizeof(int), .type = UNIFORM_BUFFER},
-		    // Binding for m
-		    {.size = sizeof(int), .type = UNIFORM_BUFFER},
-		    // Binding for k
-		    {.size = sizeof(int), .type = UNIFORM_BUFFER},
-		    // Binding for A
-		    {.size = m * k * sizeof(double), .type = STORAGE_BUFFER},
-		    // Binding for B
-		    {.size = k * n * sizeof(double), .type = STORAGE_BUFFER},
-		    // Binding for C
-		    {.size = m * n * sizeof(double), .type = STORAGE_BUFFER},
-		    // Binding for alpha
-		    {.size = sizeof(double), .type = UNIFORM_BUFFER},
-		    // Binding for beta
-		    {.size = sizeof(double), .type = UNIFORM_BUFFER},
-		};
-		CulkanLayout layout = {.bindingCount = 8, .bindings = bindings};
-
-		// Compile the shader
-		int ret = system("glslc ./src/operation.comp -o ./build/operation.spv");
-		if (ret != 0) {
-			fprintf(stderr, "Failed to compile shader\n");
-			return 1;
-		}
-
-		Culkan* culkan = culkanInit(&layout, "./build/operation.spv", (CulkanInvocations){1024, 1, 1});
+		// Bindings of the shader, for the instances created for this size too
+		bindings[OPERATION_BINDING_A].size = size_t(m) * k * sizeof(double);
+		bindings[OPERATION_BINDING_B].size = size_t(k) * n * sizeof(double);
+		bindings[OPERATION_BINDING_C].size = size_t(m) * n * sizeof(double);
+		for (uint32_t binding = 0; binding < 3; binding++) {
+			culkanResizeBinding(culkan, binding, bindings[binding].size);
+		}
+
+		// The scalars are push constants, recorded in the command buffer rather than written to buffers
+		OperationScalars scalars = {
+		    .m = uint32_t(m), .n = uint32_t(n), .k = uint32_t(k), .row_offset = 0, .alpha = alpha, .beta = beta};
+
+		// Copy of C for the CPU work overlapped with the GPU run, which owns the bindings until it is waited for
+		RightMatrix C_cpu = RightMatrix("C_cpu", m, n);
+		Kokkos::deep_copy(C_cpu, C);
 
 		// Compare all the different layout combinations
 		std::ostringstream oss;
@@ -84,23 +198,16 @@ auto main(int argc, char* argv[]) -> int {
 				  .run("GPU with memory overhead",
 				       [&]() {
 					       // Send the data to the GPU
-					       culkanWriteBinding(culkan, 0, &n);
-					       culkanWriteBinding(culkan, 1, &m);
-					       culkanWriteBinding(culkan, 2, &k);
-					       culkanWriteBinding(culkan, 3, A.data());
-					       culkanWriteBinding(culkan, 4, B.data());
-					       culkanWriteBinding(culkan, 5, C.data());
-					       culkanWriteBinding(culkan, 6, &alpha);
-					       culkanWriteBinding(culkan, 7, &beta);
+					       culkanSetPushConstants(culkan, &scalars);
+					       culkanWriteBinding(culkan, OPERATION_BINDING_A, A.data());
+					       culkanWriteBinding(culkan, OPERATION_BINDING_B, B.data());
+					       culkanWriteBinding(culkan, OPERATION_BINDING_C, C.data());
 
 					       // Do the GPU computation
-					       culkanSetup(culkan);
 					       culkanRun(culkan);
 
 					       // Read the result from the GPU
-					       double* result = (double*)malloc(m * n * sizeof(double));
-					       culkanReadBinding(culkan, 5, result);
-					       free(result);
+					       culkanReadBinding(culkan, OPERATION_BINDING_C, C.data());
 				       })
 				  .doNotOptimizeAway(A)
 				  .doNotOptimizeAway(C)
@@ -112,41 +219,295 @@ auto main(int argc, char* argv[]) -> int {
 		// Print oss
 		// std::cout << oss.str() << '\n';
 
-		for (auto const& res : result) {
-			auto measure = res.fromString("elapsed");
-			auto name    = res.config().mBenchmarkName;
-			fmt::println(
-			    "{}, Min: {}s, Max: {}s, Med: {}s", name, res.minimum(measure), res.maximum(measure), res.median(measure));
+		// The first result is the CPU kernel, the only one that the roofline of the CPU bounds
+		for (size_t i = 0; i < result.size(); i++) {
+			if (i == 0) {
+				print_result(result[i], cost, roofline);
+			}
+			else {
+				print_gpu_result(result[i], cost);
+			}
 		}
 
 		// Do it without memory overhead
 		std::ostringstream oss2;
-		culkanWriteBinding(culkan, 0, &n);
-		culkanWriteBinding(culkan, 1, &m);
-		culkanWriteBinding(culkan, 2, &k);
-		culkanWriteBinding(culkan, 3, A.data());
-		culkanWriteBinding(culkan, 4, B.data());
-		culkanWriteBinding(culkan, 5, C.data());
-		culkanWriteBinding(culkan, 6, &alpha);
-		culkanWriteBinding(culkan, 7, &beta);
-
-		culkanSetup(culkan);
+		culkanSetPushConstants(culkan, &scalars);
+		culkanWriteBinding(culkan, OPERATION_BINDING_A, A.data());
+		culkanWriteBinding(culkan, OPERATION_BINDING_B, B.data());
+		culkanWriteBinding(culkan, OPERATION_BINDING_C, C.data());
 
 		auto result2 = ankerl::nanobench::Bench()
 				   .minEpochIterations(3)
 				   .performanceCounters(true)
 				   .output(&oss2)
 				   .run("GPU without memory overhead", [&]() { culkanRun(culkan); })
+				   .run("GPU without memory overhead, overlapped with the CPU",
+					[&]() {
+						CulkanSubmission submission = culkanSubmit(culkan);
+						matrix_product_cache_blocked_i(alpha, A, B, beta, C_cpu, 8);
+						culkanWait(submission);
+					})
+				   .doNotOptimizeAway(C_cpu)
 				   .results();
 
 		for (auto const& res : result2) {
-			auto measure = res.fromString("elapsed");
-			auto name    = res.config().mBenchmarkName;
-			fmt::println(
-			    "{}, Min: {}s, Max: {}s, Med: {}s", name, res.minimum(measure), res.maximum(measure), res.median(measure));
+			print_gpu_result(res, cost);
 		}
+
+		// Tiled shader, one workgroup per 64 x 64 tile of C instead of a single workgroup.
+		// k is known when the pipeline is created, so it is specialized (OPERATION_TILED_K_SIZE, then OPERATION_TILED_TILE_K).
+		uint32_t constants[]	  = {uint32_t(k), 8};
+		CulkanLayout tiled_layout = layout;
+		tiled_layout.specializationConstants	 = constants;
+		tiled_layout.specializationConstantCount = 2;
+		Culkan* tiled = culkanInitWithContext(
+		    context, &tiled_layout, OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV), (CulkanInvocations){16, 16, 1});
+		culkanSetPushConstants(tiled, &scalars);
+		culkanWriteBinding(tiled, OPERATION_BINDING_A, A.data());
+		culkanWriteBinding(tiled, OPERATION_BINDING_B, B.data());
+		culkanWriteBinding(tiled, OPERATION_BINDING_C, C.data());
+		culkanSetup(tiled);
+		culkanSetGroupCount(tiled, operation_tiled_group_count(m, n));
+
+		std::ostringstream oss3;
+		auto result3 = ankerl::nanobench::Bench()
+				   .minEpochIterations(3)
+				   .performanceCounters(true)
+				   .output(&oss3)
+				   .run("GPU tiled without memory overhead", [&]() { culkanRun(tiled); })
+				   .results();
+
+		for (auto const& res : result3) {
+			print_gpu_result(res, cost);
+		}
+
+		// The same shader on host matrices imported as its bindings, whose writes and reads then copy nothing.
+		// Without the import they copy like the first GPU run, which is then the baseline.
+		Culkan* imported = culkanInitWithContext(
+		    context, &tiled_layout, OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV), (CulkanInvocations){16, 16, 1});
+		size_t alignment = culkanGetHostImportAlignment(culkanGetContext(imported));
+		ImportableMatrix<RightMatrix> A_host(m, k, alignment);
+		ImportableMatrix<LeftMatrix> B_host(k, n, alignment);
+		ImportableMatrix<RightMatrix> C_host(m, n, alignment);
+		Kokkos::deep_copy(A_host.view, A);
+		Kokkos::deep_copy(B_host.view, B);
+		Kokkos::deep_copy(C_host.view, C);
+		int imported_count = culkanImportBinding(imported, OPERATION_BINDING_A, A_host.view.data()) +
+				     culkanImportBinding(imported, OPERATION_BINDING_B, B_host.view.data()) +
+				     culkanImportBinding(imported, OPERATION_BINDING_C, C_host.view.data());
+		culkanSetup(imported);
+		culkanSetGroupCount(imported, operation_tiled_group_count(m, n));
+		culkanSetPushConstants(imported, &scalars);
+
+		std::ostringstream oss_imported;
+		auto result_imported = ankerl::nanobench::Bench()
+					   .minEpochIterations(3)
+					   .performanceCounters(true)
+					   .output(&oss_imported)
+					   .run(fmt::format("GPU tiled with memory overhead, {} of 3 bindings imported", imported_count),
+						[&]() {
+							culkanWriteBinding(imported, OPERATION_BINDING_A, A_host.view.data());
+							culkanWriteBinding(imported, OPERATION_BINDING_B, B_host.view.data());
+							culkanWriteBinding(imported, OPERATION_BINDING_C, C_host.view.data());
+							culkanRun(imported);
+							culkanReadBinding(imported, OPERATION_BINDING_C, C_host.view.data());
+						})
+					   .doNotOptimizeAway(C_host.view)
+					   .results();
+
+		for (auto const& res : result_imported) {
+			print_gpu_result(res, cost);
+		}
+		culkanDestroy(imported);
+
+		// A batch of products applied to C one after the other, with a submission and a wait each,
+		// or recorded in a single sequence, with barriers since each product reads the C written by the previous one
+		CulkanSequence* sequence = culkanCreateSequence(culkanGetContext(tiled));
+		culkanBeginSequence(sequence);
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			if (i != 0) {
+				culkanSequenceBarrier(sequence);
+			}
+			culkanSequenceDispatch(sequence, tiled);
+		}
+		culkanEndSequence(sequence);
+
+		ProductCost batch_cost = {.flops = cost.flops * BATCH_SIZE, .bytes = cost.bytes * BATCH_SIZE};
+		std::ostringstream oss4;
+		auto result4 = ankerl::nanobench::Bench()
+				   .minEpochIterations(3)
+				   .performanceCounters(true)
+				   .output(&oss4)
+				   .run(fmt::format("GPU tiled, batch of {} runs", BATCH_SIZE),
+					[&]() {
+						for (int i = 0; i < BATCH_SIZE; i++) {
+							culkanRun(tiled);
+						}
+					})
+				   .run(fmt::format("GPU tiled, batch of {} in one sequence", BATCH_SIZE),
+					[&]() { culkanWait(culkanSubmitSequence(sequence)); })
+				   .results();
+
+		for (auto const& res : result4) {
+			print_gpu_result(res, batch_cost);
+			fmt::println("  {:.3f}ms per product", res.median(res.fromString("elapsed")) / BATCH_SIZE * 1e3);
+		}
+
+		// Device times of the stages of a product with its transfers, from the timestamps of the sequence,
+		// without the submission and the wait of the host that the times of nanobench include
+		culkanBeginSequence(sequence);
+		culkanSequenceUpload(sequence, tiled, OPERATION_BINDING_A, 0, bindings[OPERATION_BINDING_A].size);
+		culkanSequenceUpload(sequence, tiled, OPERATION_BINDING_B, 0, bindings[OPERATION_BINDING_B].size);
+		culkanSequenceUpload(sequence, tiled, OPERATION_BINDING_C, 0, bindings[OPERATION_BINDING_C].size);
+		culkanSequenceBarrier(sequence);
+		culkanSequenceDispatch(sequence, tiled);
+		culkanSequenceBarrier(sequence);
+		culkanSequenceDownload(sequence, tiled, OPERATION_BINDING_C, 0, bindings[OPERATION_BINDING_C].size);
+		CulkanStageTimes total = {};
+		for (int i = 0; i < BATCH_SIZE; i++) {
+			CulkanStageTimes times;
+			culkanSubmitSequence(sequence);
+			if (!culkanGetSequenceTimes(sequence, &times)) {
+				fmt::println("GPU tiled stages: the queue cannot write timestamps");
+				break;
+			}
+			for (int stage = 0; stage < CULKAN_STAGE_COUNT; stage++) {
+				total.seconds[stage] += times.seconds[stage] / BATCH_SIZE;
+				total.commands[stage] = times.commands[stage];
+			}
+		}
+		fmt::println("GPU tiled stages, mean of {} runs: upload {:.3f}ms, compute {:.3f}ms ({:.2f} GFLOP/s), download {:.3f}ms{}",
+			     BATCH_SIZE,
+			     total.seconds[CULKAN_STAGE_UPLOAD] * 1e3,
+			     total.seconds[CULKAN_STAGE_COMPUTE] * 1e3,
+			     total.seconds[CULKAN_STAGE_COMPUTE] > 0 ? cost.flops / total.seconds[CULKAN_STAGE_COMPUTE] * 1e-9 : 0.0,
+			     total.seconds[CULKAN_STAGE_DOWNLOAD] * 1e3,
+			     total.commands[CULKAN_STAGE_UPLOAD] != 0 ? "" : " (bindings in host visible memory, nothing to copy)");
+
+		culkanDestroySequence(sequence);
+		culkanDestroy(tiled);
+
+		// Streamed by panels, B and the panels of A and C in a quarter of the memory of A and C, with the transfers included.
+		// With one slot the host and the device take turns on the panels, with two the host fills a panel while the device
+		// computes the other, and the uploads of a panel overlap the dispatch of the previous one unless they are serialized
+		// on the device. Small sizes have less than a tile of rows per slot in the budget, and are skipped.
+		size_t budget	= (size_t(k) * n + (size_t(m) * k + size_t(m) * n) / 4) * sizeof(double);
+		auto panel_rows = streamed_panel_rows(m, n, k, budget, gpu_memory_limits(gpu_product_cache().get_context()));
+		if (!panel_rows) {
+			fmt::println("GPU streamed skipped, {} MiB cannot hold B and a tile of rows per slot, or B is larger than a "
+				     "binding",
+				     budget >> 20);
+		}
+		else {
+			std::ostringstream oss5;
+			ankerl::nanobench::Bench bench5;
+			bench5.minEpochIterations(3).performanceCounters(true).output(&oss5);
+			struct {
+				int slots;
+				bool overlap;
+			} const configurations[] = {{1, true}, {2, false}, {2, true}};
+			std::optional<CulkanStageTimes> serialized_times;
+			for (auto const& configuration : configurations) {
+				GpuStreamedProduct streamed(m, n, k, *panel_rows, configuration.slots, configuration.overlap);
+				auto name = fmt::format("GPU streamed with memory overhead, {} panels of {} rows, {} slots{}, {} MiB "
+							"on the device",
+							streamed.panel_count(),
+							streamed.rows(),
+							configuration.slots,
+							configuration.overlap ? "" : " serialized on the device",
+							streamed.device_bytes() >> 20);
+				bench5.run(name, [&]() { streamed.run(alpha, A, B, beta, C); });
+				if (!configuration.overlap) {
+					serialized_times = streamed.stage_times();
+				}
+			}
+			bench5.doNotOptimizeAway(C);
+
+			auto results5 = bench5.results();
+			for (auto const& res : results5) {
+				print_gpu_result(res, cost);
+			}
+
+			// The same two slots with and without the overlap, the uploads can hide at most the shorter of them and the
+			// dispatches, from the exact stage times of the serialized run
+			double serialized = results5[1].median(results5[1].fromString("elapsed"));
+			double overlapped = results5[2].median(results5[2].fromString("elapsed"));
+			fmt::println("GPU streamed overlap of the uploads and the dispatches: {:.3f}ms of {:.3f}ms hidden ({:.1f}%)",
+				     (serialized - overlapped) * 1e3,
+				     serialized * 1e3,
+				     (serialized - overlapped) / serialized * 100);
+			if (serialized_times) {
+				double upload  = serialized_times->seconds[CULKAN_STAGE_UPLOAD];
+				double compute = serialized_times->seconds[CULKAN_STAGE_COMPUTE];
+				fmt::println("  serialized on the device: upload {:.3f}ms, compute {:.3f}ms, download {:.3f}ms, "
+					     "at most {:.3f}ms to hide",
+					     upload * 1e3,
+					     compute * 1e3,
+					     serialized_times->seconds[CULKAN_STAGE_DOWNLOAD] * 1e3,
+					     std::min(upload, compute) * 1e3);
+			}
+		}
+
+		// The same arguments as the CPU kernels, the first call of the size creates its plan and the next ones reuse it
+		auto first_start = std::chrono::steady_clock::now();
+		matrix_product_gpu(alpha, A, B, beta, C);
+		std::chrono::duration<double> first_time = std::chrono::steady_clock::now() - first_start;
+		fmt::println("matrix_product_gpu first call, with the creation of the plan: {:.3f} ms", first_time.count() * 1e3);
+
+		std::ostringstream oss6;
+		ankerl::nanobench::Bench bench6;
+		bench6.minEpochIterations(3).performanceCounters(true).output(&oss6);
+		bench6.run("GPU matrix_product_gpu with memory overhead, cached plan", [&]() { matrix_product_gpu(alpha, A, B, beta, C); });
+		bench6.doNotOptimizeAway(C);
+		for (auto const& res : bench6.results()) {
+			print_gpu_result(res, cost);
+		}
+
+		// Variants of the shader that the device runs: accuracy against the CPU on matrices of their own, then throughput
+		RightMatrix C_in = RightMatrix("C_in", m, n);
+		matrix_init(C_in);
+		RightMatrix C_cpu_ref = RightMatrix("C_cpu_ref", m, n);
+		Kokkos::deep_copy(C_cpu_ref, C_in);
+		matrix_product_cache_blocked_i(alpha, A, B, beta, C_cpu_ref, 8);
+
+		CulkanDeviceFeatures features	 = culkanGetDeviceFeatures(gpu_product_cache().get_context());
+		OperationVariant default_variant = gpu_product_cache().default_variant();
+		RightMatrix C_variant		 = RightMatrix("C_variant", m, n);
+		std::ostringstream oss7;
+		ankerl::nanobench::Bench bench7;
+		bench7.minEpochIterations(3).performanceCounters(true).output(&oss7);
+		for (auto const& info : OPERATION_VARIANTS) {
+			if (!operation_variant_supported(features, info.variant)) {
+				fmt::println("Variant {}: not supported by the device", info.name);
+				continue;
+			}
+			Kokkos::deep_copy(C_variant, C_in);
+			matrix_product_gpu(alpha, A, B, beta, C_variant, info.variant);
+			MatrixComparison error = matrix_compare(C_variant, C_cpu_ref);
+			fmt::println("Variant {}{}: max relative error {:.3e}, max ULP distance {}",
+				     info.name,
+				     info.variant == default_variant ? " (default)" : "",
+				     error.max_rel_error,
+				     error.max_ulp_distance);
+			bench7.run(fmt::format("GPU {} variant with memory overhead", info.name),
+				   [&]() { matrix_product_gpu(alpha, A, B, beta, C_variant, info.variant); });
+		}
+		bench7.doNotOptimizeAway(C_variant);
+		for (auto const& res : bench7.results()) {
+			print_gpu_result(res, cost);
+		}
+
+		CulkanMemoryPoolStats pool = culkanGetMemoryPoolStats(context);
+		fmt::println("Memory pool of the context: {} blocks, {} MiB reserved, {} MiB in use",
+			     pool.blockCount,
+			     pool.reservedBytes >> 20,
+			     pool.usedBytes >> 20);
 	}
 
+	culkanDestroy(culkan);
+	culkanDestroyContext(context);
+	gpu_product_cache().clear();
+
 	Kokkos::finalize();
 	exit(EXIT_SUCCESS);
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
  */
 
 #include "matrix_product.hpp"
+#include "roofline.hpp"
 
 #include <Kokkos_Core.hpp>
 #include <cstdlib>
@@ -21,6 +22,10 @@ auto main(int argc, char* argv[]) -> int {
 	int n = 2000;
 	int k = 2000;
 
+	// Work of the product and bounds of the machine
+	ProductCost cost  = product_cost(m, n, k);
+	Roofline roofline = measure_roofline();
+
 	// Generate A, B, C, with right layout
 	RightMatrix A_right = RightMatrix("A_right", m, k);
 	RightMatrix B_right = RightMatrix("B_right", k, n);
@@ -68,9 +73,7 @@ auto main(int argc, char* argv[]) -> int {
 	// std::cout << oss.str() << '\n';
 
 	for (auto const& res : result) {
-		auto measure = res.fromString("elapsed");
-		auto name    = res.config().mBenchmarkName;
-		fmt::println("{}, Min: {}s, Max: {}s, Med: {}s", name, res.minimum(measure), res.maximum(measure), res.median(measure));
+		print_result(res, cost, roofline);
 	}
 
 	Kokkos::finalize();
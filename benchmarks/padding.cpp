@@ -0,0 +1,80 @@
+/**
+ * @file benchmarks/padding.cpp
+ * @brief Benchmark of dense against padded leading dimensions, at power of two sizes where the rows of the dense
+ * matrices map onto the same cache sets.
+ */
+
+#include "matrix_product.hpp"
+#include "roofline.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <nanobench.h>
+
+#include <sstream>
+#include <string_view>
+
+// Block size of the cache blocked kernel
+constexpr int BLOCK_SIZE = 32;
+
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto run_benchmark(std::string_view kind, int size, AMatrixType& A, BMatrixType& B, CMatrixType& C, ProductCost const& cost,
+		   Roofline const& roofline) -> void {
+	matrix_init(A);
+	matrix_init(B);
+	matrix_init(C);
+
+	// Generate alpha and beta
+	double alpha = drand48();
+	double beta  = drand48();
+
+	std::ostringstream oss;
+	auto result = ankerl::nanobench::Bench()
+			  .epochs(3)
+			  .performanceCounters(true)
+			  .output(&oss)
+			  .run(fmt::format("No Cache Blocking | {} {}", kind, size), [&]() { matrix_product_reference(alpha, A, B, beta, C); })
+			  .run(fmt::format("Cache Blocked ij{} | {} {}", BLOCK_SIZE, kind, size),
+			       [&]() { matrix_product_cache_blocked_ij(alpha, A, B, beta, C, BLOCK_SIZE); })
+			  .doNotOptimizeAway(A)
+			  .doNotOptimizeAway(B)
+			  .doNotOptimizeAway(C)
+			  .doNotOptimizeAway(alpha)
+			  .doNotOptimizeAway(beta)
+			  .results();
+	for (auto const& res : result) {
+		print_result(res, cost, roofline);
+	}
+}
+
+auto main(int argc, char* argv[]) -> int {
+	Kokkos::initialize(argc, argv);
+
+	// Known seed for deterministic RNG
+	srand48(42);
+
+	Roofline roofline = measure_roofline();
+
+	constexpr int sizes[] = {1024, 2048, 4096};
+	for (int size : sizes) {
+		ProductCost cost = product_cost(size, size, size);
+
+		// Each set of matrices is freed before the next one is allocated, 4096 matrices take 128 MiB each
+		{
+			RightMatrix A = RightMatrix("A", size, size);
+			LeftMatrix B  = LeftMatrix("B", size, size);
+			RightMatrix C = RightMatrix("C", size, size);
+			run_benchmark("dense", size, A, B, C, cost, roofline);
+		}
+		{
+			StrideMatrix A = padded_right_matrix("A", size, size);
+			StrideMatrix B = padded_left_matrix("B", size, size);
+			StrideMatrix C = padded_right_matrix("C", size, size);
+			run_benchmark(fmt::format("padded to {}", padded_leading_dimension(size)), size, A, B, C, cost, roofline);
+		}
+	}
+
+	Kokkos::finalize();
+	exit(EXIT_SUCCESS);
+}
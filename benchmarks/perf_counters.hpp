@@ -0,0 +1,235 @@
+/**
+ * @file benchmarks/perf_counters.hpp
+ * @brief Hardware performance counters of the whole process around a product call, through perf_event_open.
+ *
+ * A group of counters is opened for every thread of the process, so that the OpenMP threads of Kokkos are counted
+ * and not only the calling thread. It must therefore be created after Kokkos::initialize.
+ * Events that cannot be opened (no PMU, perf_event_paranoid, virtual machines, other OSes) are reported as unavailable.
+ */
+
+#ifndef TOP_BENCHMARKS_PERF_COUNTERS_HPP
+#define TOP_BENCHMARKS_PERF_COUNTERS_HPP
+
+#include <Kokkos_Core.hpp>
+#include <array>
+#include <cstdint>
+#include <fmt/core.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#	include <cstdlib>
+#	include <dirent.h>
+#	include <linux/perf_event.h>
+#	include <sys/ioctl.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif
+
+enum class PerfEvent {
+	Cycles,
+	Instructions,
+	L1DMisses,
+	LLCMisses,
+	DTLBMisses,
+};
+
+constexpr size_t PERF_EVENT_COUNT = 5;
+
+constexpr std::array<std::string_view, PERF_EVENT_COUNT> PERF_EVENT_NAMES = {
+    "cycles",
+    "instructions",
+    "L1D misses",
+    "LLC misses",
+    "dTLB misses",
+};
+
+/**
+ * @brief Counter values summed over all threads, empty for the events that could not be counted
+ */
+struct PerfSample {
+	std::array<std::optional<double>, PERF_EVENT_COUNT> values;
+
+	auto operator[](PerfEvent event) const -> std::optional<double> const& {
+		return values[size_t(event)];
+	}
+};
+
+/**
+ * @brief Formats a sample as comma separated fields, to be appended to a result line
+ */
+inline auto format_sample(PerfSample const& sample) -> std::string {
+	std::string fields;
+	for (size_t event = 0; event < PERF_EVENT_COUNT; event++) {
+		if (sample.values[event]) {
+			fields += fmt::format(", {}: {:.4g}", PERF_EVENT_NAMES[event], *sample.values[event]);
+		}
+		else {
+			fields += fmt::format(", {}: n/a", PERF_EVENT_NAMES[event]);
+		}
+	}
+	auto const& cycles	 = sample[PerfEvent::Cycles];
+	auto const& instructions = sample[PerfEvent::Instructions];
+	if (cycles && instructions && *cycles > 0.0) {
+		fields += fmt::format(", IPC: {:.3f}", *instructions / *cycles);
+	}
+	return fields;
+}
+
+class PerfCounters {
+      public:
+	PerfCounters() {
+#ifdef __linux__
+		DIR* tasks = opendir("/proc/self/task");
+		if (tasks == nullptr) {
+			return;
+		}
+		while (dirent* entry = readdir(tasks)) {
+			if (entry->d_name[0] == '.') {
+				continue;
+			}
+			open_thread_group(pid_t(std::atoi(entry->d_name)));
+		}
+		closedir(tasks);
+#endif
+	}
+
+	PerfCounters(PerfCounters const&)		     = delete;
+	auto operator=(PerfCounters const&) -> PerfCounters& = delete;
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (auto const& group : groups) {
+			for (int fd : group.fds) {
+				close(fd);
+			}
+		}
+#endif
+	}
+
+	/**
+	 * @brief Whether at least one event could be opened on at least one thread
+	 */
+	auto available() const -> bool {
+		return !groups.empty();
+	}
+
+	auto start() -> void {
+#ifdef __linux__
+		for (auto const& group : groups) {
+			ioctl(group.fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(group.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+
+	/**
+	 * @brief Stops the counters and sums them over all threads, scaled up if the kernel had to multiplex them
+	 */
+	auto stop() -> PerfSample {
+		PerfSample sample;
+#ifdef __linux__
+		for (auto const& group : groups) {
+			ioctl(group.fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+		}
+		for (auto const& group : groups) {
+			// Layout of PERF_FORMAT_GROUP with the enabled and running times
+			struct {
+				uint64_t nr;
+				uint64_t time_enabled;
+				uint64_t time_running;
+				uint64_t values[PERF_EVENT_COUNT];
+			} data{};
+			if (read(group.fds[0], &data, sizeof(data)) <= 0 || data.time_running == 0) {
+				continue;
+			}
+			double scale = double(data.time_enabled) / double(data.time_running);
+			for (size_t i = 0; i < data.nr && i < group.events.size(); i++) {
+				auto& value = sample.values[size_t(group.events[i])];
+				value	    = value.value_or(0.0) + double(data.values[i]) * scale;
+			}
+		}
+#endif
+		return sample;
+	}
+
+	/**
+	 * @brief Counts the events of a single call of f
+	 */
+	template <class F> auto count(F&& f) -> PerfSample {
+		start();
+		f();
+		Kokkos::fence();
+		return stop();
+	}
+
+      private:
+	struct ThreadGroup {
+		std::vector<int> fds;		 // The first one is the group leader
+		std::vector<PerfEvent> events; // Event counted by each fd, in the order of the group
+	};
+
+	std::vector<ThreadGroup> groups;
+
+#ifdef __linux__
+	static auto event_attr(PerfEvent event) -> perf_event_attr {
+		auto cache_miss = [](uint64_t cache) {
+			return cache | (uint64_t(PERF_COUNT_HW_CACHE_OP_READ) << 8) | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+		};
+
+		perf_event_attr attr{};
+		attr.size	   = sizeof(attr);
+		attr.read_format   = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		attr.exclude_hv	   = 1;
+		attr.exclude_kernel = 1;
+		switch (event) {
+			case PerfEvent::Cycles:
+				attr.type   = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_CPU_CYCLES;
+				break;
+			case PerfEvent::Instructions:
+				attr.type   = PERF_TYPE_HARDWARE;
+				attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+				break;
+			case PerfEvent::L1DMisses:
+				attr.type   = PERF_TYPE_HW_CACHE;
+				attr.config = cache_miss(PERF_COUNT_HW_CACHE_L1D);
+				break;
+			case PerfEvent::LLCMisses:
+				attr.type   = PERF_TYPE_HW_CACHE;
+				attr.config = cache_miss(PERF_COUNT_HW_CACHE_LL);
+				break;
+			case PerfEvent::DTLBMisses:
+				attr.type   = PERF_TYPE_HW_CACHE;
+				attr.config = cache_miss(PERF_COUNT_HW_CACHE_DTLB);
+				break;
+		}
+		return attr;
+	}
+
+	/**
+	 * @brief Opens all the events that are supported as a single group on a thread
+	 */
+	auto open_thread_group(pid_t tid) -> void {
+		ThreadGroup group;
+		for (size_t event = 0; event < PERF_EVENT_COUNT; event++) {
+			perf_event_attr attr = event_attr(PerfEvent(event));
+			int leader	     = group.fds.empty() ? -1 : group.fds[0];
+			attr.disabled	     = leader == -1 ? 1 : 0; // Members follow the leader
+			int fd		     = int(syscall(SYS_perf_event_open, &attr, tid, -1, leader, 0));
+			if (fd >= 0) {
+				group.fds.push_back(fd);
+				group.events.push_back(PerfEvent(event));
+			}
+		}
+		if (!group.fds.empty()) {
+			groups.push_back(std::move(group));
+		}
+	}
+#endif
+};
+
+#endif
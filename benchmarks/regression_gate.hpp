@@ -0,0 +1,127 @@
+/**
+ * @file benchmarks/regression_gate.hpp
+ * @brief Comparison of benchmark results against a stored baseline, to catch performance regressions.
+ *
+ * The baseline is a tab separated file with one line per shape, thread count and kernel:
+ *   <bench title> | threads=<T> | <run name>	<median (s)>	<minimum (s)>	<noise>
+ * where the noise is the median absolute percent error of the epochs (0.01 for 1%).
+ */
+
+#ifndef TOP_BENCHMARKS_REGRESSION_GATE_HPP
+#define TOP_BENCHMARKS_REGRESSION_GATE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <fmt/core.h>
+#include <fstream>
+#include <map>
+#include <nanobench.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+struct BaselineEntry {
+	double median;	// Median time of the epochs, in seconds
+	double minimum; // Minimum time of the epochs, in seconds
+	double noise;	// Median absolute percent error of the epochs
+};
+
+using Baseline = std::map<std::string, BaselineEntry>;
+
+/**
+ * @brief Key of a result in the baseline, with the number of threads it ran on, so that runs on different thread counts are
+ * never compared
+ */
+inline auto baseline_key(ankerl::nanobench::Result const& res, int threads) -> std::string {
+	return fmt::format("{} | threads={} | {}", res.config().mBenchmarkTitle, threads, res.config().mBenchmarkName);
+}
+
+inline auto baseline_entry(ankerl::nanobench::Result const& res) -> BaselineEntry {
+	auto measure = res.fromString("elapsed");
+	return BaselineEntry{
+	    .median  = res.median(measure),
+	    .minimum = res.minimum(measure),
+	    .noise   = res.medianAbsolutePercentError(measure),
+	};
+}
+
+/**
+ * @brief Loads a baseline file. A missing file gives an empty baseline.
+ */
+inline auto load_baseline(std::string const& path) -> Baseline {
+	Baseline baseline;
+	std::ifstream file(path);
+	std::string line;
+	while (std::getline(file, line)) {
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream fields(line);
+		std::string key;
+		BaselineEntry entry{};
+		if (std::getline(fields, key, '\t') && fields >> entry.median >> entry.minimum >> entry.noise) {
+			baseline[key] = entry;
+		}
+	}
+	return baseline;
+}
+
+inline auto save_baseline(std::string const& path, Baseline const& baseline) -> bool {
+	std::ofstream file(path);
+	file << "# shape | threads | kernel\tmedian (s)\tminimum (s)\tnoise (median absolute percent error)\n";
+	for (auto const& [key, entry] : baseline) {
+		file << fmt::format("{}\t{:.9g}\t{:.9g}\t{:.6g}\n", key, entry.median, entry.minimum, entry.noise);
+	}
+	return bool(file);
+}
+
+/**
+ * @brief Whether the current timings are a significant regression over the baseline.
+ * All three conditions must hold, so that a noisy epoch alone cannot fail the gate:
+ * - the median is slower by more than the threshold,
+ * - the minimum is slower by more than the threshold, meaning that even the best epoch got slower,
+ * - the median is slower by more than 3 times the combined noise of both runs.
+ * @param threshold relative slowdown that is tolerated, 0.05 for 5%
+ */
+inline auto is_regression(BaselineEntry const& baseline, BaselineEntry const& current, double threshold) -> bool {
+	double median_change  = current.median / baseline.median - 1.0;
+	double minimum_change = current.minimum / baseline.minimum - 1.0;
+	double noise	      = std::hypot(baseline.noise, current.noise);
+	return median_change > threshold && minimum_change > threshold && median_change > 3.0 * noise;
+}
+
+/**
+ * @brief Compares all the results of a bench against the baseline, and reports each of them on stderr.
+ * @return false if at least one result is a regression
+ */
+inline auto check_against_baseline(Baseline const& baseline, ankerl::nanobench::Bench const& bench, double threshold, int threads)
+    -> bool {
+	bool passed = true;
+	for (auto const& res : bench.results()) {
+		auto key     = baseline_key(res, threads);
+		auto current = baseline_entry(res);
+		auto found   = baseline.find(key);
+		if (found == baseline.end()) {
+			fmt::println(stderr, "{}: no baseline", key);
+			continue;
+		}
+
+		auto const& base  = found->second;
+		bool regression	  = is_regression(base, current, threshold);
+		double change	  = 100.0 * (current.median / base.median - 1.0);
+		std::string_view verdict = regression ? "REGRESSION" : (change < 0.0 ? "faster" : "ok");
+		fmt::println(stderr,
+			     "{}: baseline {:.6g}s, current {:.6g}s, change {:+.2f}%, noise {:.2f}%/{:.2f}%, {}",
+			     key,
+			     base.median,
+			     current.median,
+			     change,
+			     100.0 * base.noise,
+			     100.0 * current.noise,
+			     verdict);
+		passed = passed && !regression;
+	}
+	return passed;
+}
+
+#endif
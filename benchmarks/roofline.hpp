@@ -0,0 +1,169 @@
+/**
+ * @file benchmarks/roofline.hpp
+ * @brief Flop and byte counts of the matrix product, and roofline of the current machine measured at startup.
+ */
+
+#ifndef TOP_BENCHMARKS_ROOFLINE_HPP
+#define TOP_BENCHMARKS_ROOFLINE_HPP
+
+#include <Kokkos_Core.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fmt/core.h>
+#include <nanobench.h>
+#include <string_view>
+
+/**
+ * @brief Amount of work and compulsory memory traffic of one matrix product
+ */
+struct ProductCost {
+	double flops; // Floating point operations, 2·m·n·k
+	double bytes; // Bytes moved at least once between memory and the core: A and B read, C read and written
+
+	auto intensity() const -> double {
+		return flops / bytes;
+	}
+};
+
+inline auto product_cost(int m, int n, int k) -> ProductCost {
+	double md = m;
+	double nd = n;
+	double kd = k;
+	return ProductCost{
+	    .flops = 2.0 * md * nd * kd,
+	    .bytes = (md * kd + kd * nd + 2.0 * md * nd) * sizeof(double),
+	};
+}
+
+/**
+ * @brief Achievable compute and memory bounds of the machine, with the flags the kernels are compiled with
+ */
+struct Roofline {
+	double peak_gflops;   // Multiply-add throughput of all the threads
+	double bandwidth_gbs; // STREAM triad bandwidth of all the threads
+
+	auto attainable_gflops(double intensity) const -> double {
+		return std::min(peak_gflops, intensity * bandwidth_gbs);
+	}
+};
+
+/**
+ * @brief Measures the multiply-add throughput with independent chains on every thread, best of 3 runs
+ */
+inline auto measure_peak_gflops() -> double {
+	constexpr int CHAINS	  = 32; // Enough independent chains to hide the latency of the floating point units
+	constexpr long ITERATIONS = 1 << 22;
+	int nb_threads		  = Kokkos::DefaultExecutionSpace().concurrency();
+
+	double best = 0.0;
+	for (int rep = 0; rep < 3; rep++) {
+		double sink = 0.0;
+		auto start  = std::chrono::steady_clock::now();
+		Kokkos::parallel_reduce(
+		    "roofline_peak",
+		    nb_threads,
+		    KOKKOS_LAMBDA(int thread, double& sum) {
+			    double acc[CHAINS];
+			    for (int c = 0; c < CHAINS; c++) {
+				    acc[c] = thread + c;
+			    }
+			    for (long it = 0; it < ITERATIONS; it++) {
+				    for (int c = 0; c < CHAINS; c++) {
+					    acc[c] = acc[c] * 0.999999 + 1e-7;
+				    }
+			    }
+			    for (int c = 0; c < CHAINS; c++) {
+				    sum += acc[c];
+			    }
+		    },
+		    sink);
+		Kokkos::fence();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		ankerl::nanobench::doNotOptimizeAway(sink);
+
+		double flops = 2.0 * CHAINS * ITERATIONS * nb_threads;
+		best	     = std::max(best, flops / elapsed.count() / 1e9);
+	}
+	return best;
+}
+
+/**
+ * @brief Measures the STREAM triad bandwidth on arrays much larger than the last level cache, best of 5 runs
+ */
+inline auto measure_stream_bandwidth() -> double {
+	constexpr size_t N = size_t(1) << 24;
+	Kokkos::View<double*> a("stream_a", N);
+	Kokkos::View<double*> b("stream_b", N);
+	Kokkos::View<double*> c("stream_c", N);
+	Kokkos::parallel_for(
+	    "roofline_stream_init", N, KOKKOS_LAMBDA(size_t i) {
+		    a(i) = 0.0;
+		    b(i) = 1.0;
+		    c(i) = 2.0;
+	    });
+	Kokkos::fence();
+
+	double best = 0.0;
+	for (int rep = 0; rep < 5; rep++) {
+		auto start = std::chrono::steady_clock::now();
+		Kokkos::parallel_for(
+		    "roofline_stream_triad", N, KOKKOS_LAMBDA(size_t i) { a(i) = b(i) + 3.0 * c(i); });
+		Kokkos::fence();
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		// Same convention as STREAM: write allocation traffic is not counted
+		double bytes = 3.0 * sizeof(double) * N;
+		best	     = std::max(best, bytes / elapsed.count() / 1e9);
+	}
+	ankerl::nanobench::doNotOptimizeAway(a);
+	return best;
+}
+
+inline auto measure_roofline() -> Roofline {
+	return Roofline{
+	    .peak_gflops   = measure_peak_gflops(),
+	    .bandwidth_gbs = measure_stream_bandwidth(),
+	};
+}
+
+/**
+ * @brief Prints the timings of a result, followed by its GFLOP/s, arithmetic intensity and position on the roofline.
+ * The GFLOP/s are computed from the median time.
+ * @param extra_fields comma separated fields appended to the line, such as hardware counters
+ */
+inline auto print_result(ankerl::nanobench::Result const& res, ProductCost const& cost, Roofline const& roofline,
+			 std::string_view extra_fields = "") -> void {
+	auto measure	  = res.fromString("elapsed");
+	auto name	  = res.config().mBenchmarkName;
+	double gflops	  = cost.flops / res.median(measure) / 1e9;
+	double attainable = roofline.attainable_gflops(cost.intensity());
+	fmt::println("{}, Min: {}s, Max: {}s, Med: {}s, GFLOP/s: {:.3f}, AI: {:.3f} flop/B, Roofline: {:.1f}% of {:.3f} GFLOP/s{}",
+		     name,
+		     res.minimum(measure),
+		     res.maximum(measure),
+		     res.median(measure),
+		     gflops,
+		     cost.intensity(),
+		     100.0 * gflops / attainable,
+		     attainable,
+		     extra_fields);
+}
+
+/**
+ * @brief Prints the timings of a result run on the GPU and its GFLOP/s, without a position on the roofline,
+ * which is measured on the CPU and does not bound the GPU
+ */
+inline auto print_gpu_result(ankerl::nanobench::Result const& res, ProductCost const& cost) -> void {
+	auto measure  = res.fromString("elapsed");
+	auto name     = res.config().mBenchmarkName;
+	double gflops = cost.flops / res.median(measure) / 1e9;
+	fmt::println("{}, Min: {}s, Max: {}s, Med: {}s, GFLOP/s: {:.3f}, AI: {:.3f} flop/B",
+		     name,
+		     res.minimum(measure),
+		     res.maximum(measure),
+		     res.median(measure),
+		     gflops,
+		     cost.intensity());
+}
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file benchmarks/shape_sweep.cpp
+ * @brief Benchmark of every kernel over non-square, prime and power of two ± 1 shapes.
+ * Plotted as a heat map of GFLOP/s by scripts/shape_sweep_heatmap.py.
+ */
+
+#include "kernels.hpp"
+#include "matrix_product.hpp"
+#include "roofline.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <nanobench.h>
+
+#include <sstream>
+#include <string_view>
+
+struct Shape {
+	std::string_view kind;
+	int m;
+	int n;
+	int k;
+};
+
+// Power of two sizes map the rows of the matrices onto the same cache sets, and prime sizes never fill the last block
+constexpr Shape SHAPES[] = {
+    // Powers of two and their neighbours
+    {"pow2-1", 255, 255, 255},
+    {"pow2", 256, 256, 256},
+    {"pow2+1", 257, 257, 257},
+    {"pow2-1", 511, 511, 511},
+    {"pow2", 512, 512, 512},
+    {"pow2+1", 513, 513, 513},
+    {"pow2-1", 1023, 1023, 1023},
+    {"pow2", 1024, 1024, 1024},
+    {"pow2+1", 1025, 1025, 1025},
+    // Primes
+    {"prime", 251, 251, 251},
+    {"prime", 509, 509, 509},
+    {"prime", 1021, 1021, 1021},
+    {"prime", 1021, 127, 509},
+    // Tall and skinny C, many rows and few columns
+    {"tall-skinny", 8192, 32, 512},
+    {"tall-skinny", 16384, 8, 1024},
+    // Short and wide C, few rows and many columns
+    {"short-wide", 32, 8192, 512},
+    {"short-wide", 8, 16384, 1024},
+};
+
+// Block size of the cache blocked kernels
+constexpr int BLOCK_SIZE = 32;
+
+auto main(int argc, char* argv[]) -> int {
+	Kokkos::initialize(argc, argv);
+
+	// Known seed for deterministic RNG
+	srand48(42);
+
+	Roofline roofline = measure_roofline();
+
+	for (auto const& shape : SHAPES) {
+		ProductCost cost = product_cost(shape.m, shape.n, shape.k);
+
+		// Generate A, B, C
+		RightMatrix A = RightMatrix("A", shape.m, shape.k);
+		LeftMatrix B  = LeftMatrix("B", shape.k, shape.n);
+		RightMatrix C = RightMatrix("C", shape.m, shape.n);
+		matrix_init(A);
+		matrix_init(B);
+		matrix_init(C);
+
+		// Generate alpha and beta
+		double alpha = drand48();
+		double beta  = drand48();
+
+		std::ostringstream oss;
+		ankerl::nanobench::Bench bench;
+		bench.epochs(3).performanceCounters(true).output(&oss);
+		for (auto const& info : KERNELS) {
+			auto name = fmt::format("{} | {} {}x{}x{}", kernel_label(info.kernel, BLOCK_SIZE), shape.kind, shape.m, shape.n, shape.k);
+			bench.run(name, [&]() { kernel_run(info.kernel, alpha, A, B, beta, C, BLOCK_SIZE); });
+		}
+
+		// The dispatcher picks its kernel during the warmup, so the epochs only measure the chosen kernel.
+		// Its row keeps a single name over the shapes, and the chosen kernel is printed on a line of its own.
+		KernelDispatcher dispatcher(BLOCK_SIZE);
+		Kernel chosen = dispatcher.run(alpha, A, B, beta, C);
+		fmt::println("Dispatched to {} for {} {}x{}x{}", kernel_info(chosen).name, shape.kind, shape.m, shape.n, shape.k);
+		auto name = fmt::format("Dispatched | {} {}x{}x{}", shape.kind, shape.m, shape.n, shape.k);
+		bench.run(name, [&]() { dispatcher.run(alpha, A, B, beta, C); });
+		bench.doNotOptimizeAway(A).doNotOptimizeAway(B).doNotOptimizeAway(C).doNotOptimizeAway(alpha).doNotOptimizeAway(beta);
+
+		for (auto const& res : bench.results()) {
+			print_result(res, cost, roofline);
+		}
+	}
+
+	Kokkos::finalize();
+	exit(EXIT_SUCCESS);
+}
@@ -26,6 +26,11 @@ typedef enum {
 	FILE_NOT_FOUND,
 	TOO_MANY_INVOCATIONS,
 	NOT_ENOUGH_MEMORY,
+	UNSUPPORTED_FEATURE,
+	WRONG_CONTEXT,     // An instance or a submission used with a sequence of another context
+	NOT_RECORDING,     // A command recorded in a sequence outside culkanBeginSequence() and culkanEndSequence()
+	NOT_SET_UP,        // An instance dispatched before culkanSetup()
+	BINDING_TOO_LARGE, // A binding larger than a descriptor of its type can cover, see culkanGetMaxBindingSize()
 } CulkanErrCodes;
 
 /**
@@ -103,12 +108,66 @@ typedef struct {
 		ptr;                                                                                                                       \
 	})
 
+struct CulkanContext;
+
+// Size of the blocks of device memory of a context, from which the buffers are suballocated. Larger buffers get a block of their own.
+#define CULKAN_MEMORY_BLOCK_SIZE ((VkDeviceSize)64 << 20)
+
+typedef struct {
+	VkDeviceSize offset;
+	VkDeviceSize size;
+} CulkanMemoryRange;
+
+/**
+ * @brief Block of device memory of a single memory type, shared by the buffers of all the instances of a context
+ */
+typedef struct CulkanMemoryBlock {
+	VkDeviceMemory memory;
+	uint32_t memoryTypeIndex;
+	VkDeviceSize size;
+	void* mapped;			// Mapped once for the lifetime of the block if it is host visible, NULL otherwise
+	CulkanMemoryRange* freeRanges;	// Sorted by offset, neighbouring free ranges are merged
+	uint32_t freeCount;
+	uint32_t freeCapacity;
+	uint32_t allocationCount;	// Block released once it has none, if it holds a single large buffer
+	struct CulkanMemoryBlock* next; // Next block of the context
+} CulkanMemoryBlock;
+
+/**
+ * @brief Range of a block of memory holding a buffer, offset and size aligned on nonCoherentAtomSize so that it is flushed on its own
+ */
+typedef struct {
+	CulkanMemoryBlock* block; // NULL if the buffer is not in the memory pool
+	VkDeviceSize offset;
+	VkDeviceSize size;
+} CulkanAllocation;
+
+/**
+ * @brief Memory of the pool of a context, see culkanGetMemoryPoolStats()
+ */
+typedef struct {
+	uint32_t blockCount;
+	size_t reservedBytes; // Allocated from the device, in all the blocks
+	size_t usedBytes;     // Suballocated to buffers, alignment padding included
+} CulkanMemoryPoolStats;
+
+/**
+ * @brief Features of the device of a context that decide which variant of a shader it can run, see culkanGetDeviceFeatures()
+ */
+typedef struct {
+	int shaderFloat64;         // Whether the shaders can use doubles, enabled on the device when it supports them
+	uint32_t subgroupSize;     // Invocations of a subgroup, 1 before Vulkan 1.1
+	int subgroupShuffle;       // Whether compute shaders can use subgroupShuffle() and subgroupShuffleXor()
+	int fullSubgroups;         // Whether compute pipelines can require full subgroups of subgroupSize invocations, from Vulkan 1.3
+	uint32_t sharedMemorySize; // Bytes of shared memory of a workgroup, maxComputeSharedMemorySize
+} CulkanDeviceFeatures;
+
 typedef struct {
 	VkBufferCreateInfo* bufferCreateInfoVar;
 	VkBuffer* vkBufferVar;
 
 	VkMemoryRequirements memoryRequirementsVar;
-	VkMemoryAllocateInfo memoryAllocateInfoVar;
+	CulkanAllocation allocationVar; // Of the buffer in the memory pool of the context, deviceMemoryVar is the memory of its block
 
 	// TODO : see if they are needed
 	VkDevice deviceVar;
@@ -119,7 +178,18 @@ typedef struct {
 	VkDescriptorBufferInfo* bufferInfoVar;
 
 	size_t sizeOfVar;
-	void* dataVar;
+	void* dataVar; // Mapped once at allocation, until culkanDestroy(). Memory of the staging buffer if there is one.
+	VkMemoryPropertyFlags memoryPropertyFlagsVar;
+
+	// Host visible copy of a device local buffer, VK_NULL_HANDLE when the buffer itself is host visible
+	VkBuffer stagingBufferVar;
+	VkDeviceMemory stagingMemoryVar;
+	CulkanAllocation stagingAllocationVar;
+	VkMemoryPropertyFlags stagingMemoryPropertyFlagsVar;
+	struct CulkanContext* contextVar; // Context owning the queue of the staging copies
+	int uploadPendingVar;		  // Whether the staging buffer was flushed and waits in the pending uploads of the context
+
+	void* importedVar; // Host allocation the buffer is bound to by culkanImportBinding(), NULL if culkan allocated the memory
 } GPUVariable;
 
 typedef enum {
@@ -139,6 +209,15 @@ typedef struct {
 typedef struct {
 	uint32_t bindingCount;
 	CulkanBinding* bindings;
+	// Size in bytes of the push constant block of the shader, 0 if it has none. Set with culkanSetPushConstants().
+	uint32_t pushConstantSize;
+	// Values of the specialization constants of the shader, the i-th one is constant_id = i.
+	// Read when the pipeline is created by culkanSetup(), NULL to keep the defaults of the shader.
+	const uint32_t* specializationConstants;
+	uint32_t specializationConstantCount;
+	// If not 0, the invocations of a workgroup run in full subgroups of this size, which must be the subgroupSize of the device
+	// and a divisor of the workgroup size. culkanSetup() fails with UNSUPPORTED_FEATURE if the device lacks fullSubgroups.
+	uint32_t requiredSubgroupSize;
 } CulkanLayout;
 
 typedef struct {
@@ -146,10 +225,14 @@ typedef struct {
 } CulkanInvocations;
 
 typedef struct {
-	const CulkanLayout* layout;
-	const char* shaderPath;
-	CulkanInvocations invocations;
-	GPUVariable* variables;
+	uint32_t x, y, z;
+} CulkanGroupCount;
+
+/**
+ * @brief A Vulkan instance, device and compute queue, shared by any number of Culkan instances (one pipeline each),
+ * so that several shaders run on the same device and are chained in a CulkanSequence
+ */
+typedef struct CulkanContext {
 	CulkanResult result;
 	VkApplicationInfo appInfo;
 	VkInstanceCreateInfo createInfo;
@@ -160,12 +243,57 @@ typedef struct {
 	VkPhysicalDeviceProperties deviceProperties;
 	uint32_t queueFamilyCount;
 	VkQueueFamilyProperties* queueFamilies;
-	VkDeviceQueueCreateInfo queueCreateInfo;
 	uint32_t family;
 	float* queuePriorities;
 	VkDeviceCreateInfo deviceCreateInfo;
 	VkDevice device;
 	VkPhysicalDeviceMemoryProperties memoryProperties;
+	VkQueue queue;
+
+	// Pool of the command buffers of all the instances and sequences of the context
+	VkCommandPoolCreateInfo commandPoolCreateInfo;
+	VkCommandPool commandPool;
+
+	// One-time command buffer of the copies between the staging and device local buffers
+	VkCommandBuffer transferCommandBuffer;
+	VkFence transferFence;
+	int transferPending; // Whether the uploads submitted by culkanSubmitUploads() may still be running
+
+	// Staging buffers flushed by the host since the last submission, uploaded together ahead of the next one
+	GPUVariable** pendingUploads;
+	uint32_t pendingUploadCount;
+	uint32_t pendingUploadCapacity;
+
+	VkPipelineCache pipelineCache; // Of all the pipelines of the context, loaded from pipelineCachePath and saved back on destruction
+	char* pipelineCachePath;       // NULL if the pipeline cache is not persisted
+
+	// Timeline semaphore signaled by the submissions of the sequences, with increasing values.
+	// VK_NULL_HANDLE if the device does not support timeline semaphores (Vulkan 1.1), then each sequence signals a fence.
+	VkSemaphore timeline;
+	uint64_t timelineValue; // Last value signaled by a submission
+
+	uint64_t timestampMask; // Valid bits of the timestamps written on the queue, 0 if it cannot write timestamps
+
+	// Import of host allocations as bindings (VK_EXT_external_memory_host), NULL if the device does not support it
+	PFN_vkGetMemoryHostPointerPropertiesEXT getMemoryHostPointerProperties;
+	VkDeviceSize hostImportAlignment; // Of the pointers and sizes imported, 0 if the device does not support the import
+
+	CulkanMemoryBlock* memoryBlocks; // Memory pool of the buffers of the instances, kept until the context is destroyed
+
+	CulkanDeviceFeatures features; // Queried when the device is created
+} CulkanContext;
+
+typedef struct Culkan {
+	CulkanContext* context;
+	int ownsContext; // Whether the context was created by culkanInit(), and is destroyed with the instance
+	const CulkanLayout* layout;
+	const char* shaderPath;	    // NULL if the shader was given in memory
+	const uint32_t* shaderCode; // SPIR-V given to culkanInitFromMemory(), NULL if it is read from shaderPath
+	size_t shaderCodeSize;	    // Size of shaderCode, in bytes
+	CulkanInvocations invocations;
+	CulkanGroupCount groupCount; // Workgroups dispatched by each run, (1, 1, 1) unless set by culkanSetGroupCount()
+	GPUVariable* variables;
+	CulkanResult result;
 
 	VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo;
 	VkDescriptorSetLayout descriptorSetLayout;
@@ -189,19 +317,64 @@ typedef struct {
 	VkComputePipelineCreateInfo pipelineCreateInfo;
 	VkPipeline pipeline;
 
-	VkCommandPoolCreateInfo commandPoolCreateInfo;
-	VkCommandPool commandPool;
-	VkCommandBufferAllocateInfo commandBufferAllocateInfo;
 	VkCommandBuffer commandBuffer;
 	VkCommandBufferBeginInfo commandBufferBeginInfo;
 
-	VkFence computeFence;
-	VkFenceCreateInfo fenceCreateInfo;
+	void* pushConstantData;	    // Pushed by the command buffer, pushConstantSize bytes
+	int commandBufferDirty;	    // Whether the command buffer must be recorded again before the next run
+	VkFence computeFence;	    // Reset by culkanWait(), reused by every run
+	int computePending;	    // Whether a submission has not been waited for yet
+} Culkan;
 
-	VkQueue queue;
+/**
+ * @brief Stages of the commands of a sequence, whose device times are summed by culkanGetSequenceTimes()
+ */
+typedef enum {
+	CULKAN_STAGE_UPLOAD,   // culkanSequenceUpload()
+	CULKAN_STAGE_COMPUTE,  // culkanSequenceDispatch()
+	CULKAN_STAGE_DOWNLOAD, // culkanSequenceDownload()
+	CULKAN_STAGE_COPY,     // culkanSequenceCopyBinding()
+	CULKAN_STAGE_COUNT,
+} CulkanStage;
 
-	VkCommandBuffer* commandBuffers;
-} Culkan;
+/**
+ * @brief Device times of the last submission of a sequence, per stage
+ */
+typedef struct {
+	double seconds[CULKAN_STAGE_COUNT];    // Sum of the times of the commands of each stage
+	uint32_t commands[CULKAN_STAGE_COUNT]; // Number of timed commands of each stage
+} CulkanStageTimes;
+
+// Commands of a sequence timed by culkanGetSequenceTimes(), the ones recorded past them are not timed
+#define CULKAN_MAX_TIMED_COMMANDS 64
+
+/**
+ * @brief Command buffer of several dispatches, of any instances of a context, separated by barriers.
+ * A whole batch of dispatches is submitted at once by culkanSubmitSequence(), so that the cost of a submission is paid once.
+ */
+typedef struct {
+	CulkanContext* context;
+	VkCommandBuffer commandBuffer;
+	uint64_t value; // Value of the timeline of the context signaled by the last submission
+	VkFence fence;	// Signaled by the submissions instead when the context has no timeline, VK_NULL_HANDLE otherwise
+	int pending;	// Whether a submission has not been waited for yet
+	int recording;	// Between culkanBeginSequence() and culkanEndSequence()
+
+	// Two timestamps around each timed command, VK_NULL_HANDLE if the queue cannot write timestamps
+	VkQueryPool queryPool;
+	uint32_t timedCount;				    // Commands timed since culkanBeginSequence()
+	CulkanStage timedStages[CULKAN_MAX_TIMED_COMMANDS]; // Stage of each timed command
+} CulkanSequence;
+
+/**
+ * @brief A submission of culkanSubmit() or culkanSubmitSequence(), to be waited for with culkanWait()
+ */
+typedef struct {
+	CulkanContext* context;
+	VkFence fence;	// Signaled by a run or by a sequence without timeline, VK_NULL_HANDLE for a sequence on the timeline
+	uint64_t value; // Value of the timeline of the context signaled by a sequence
+	int* pending;	// Cleared by culkanWait(), so that the fence is only waited for and reset once
+} CulkanSubmission;
 
 /**
  * @brief Gets a GPUVariable from a Culkan instance
@@ -245,6 +418,95 @@ void culkanReadGPUVariable(GPUVariable* variable, void* dst, CulkanResult* resul
  */
 void culkanReadBinding(Culkan* culkan, uint32_t binding, void* dst);
 
+/**
+ * @brief Gets a pointer to the mapped memory of a binding, to write or read it without a copy.
+ * The memory stays mapped for the lifetime of the instance. For a device local binding it is the memory of its staging buffer.
+ * Writes must be followed by culkanFlushBinding() before running the shader, and reads preceded by culkanInvalidateBinding()
+ * after running it, both are free for host visible and coherent memory.
+ * @param culkan the Culkan instance
+ * @param binding the binding to get the memory of
+ * @return the mapped memory of the binding
+ */
+void* culkanGetBindingPointer(Culkan* culkan, uint32_t binding);
+
+/**
+ * @brief Makes the host writes to the mapped memory of a binding visible to the device: flushes non-coherent memory, and
+ * queues the upload of the staging buffer of a device local binding. The next culkanSubmit() or culkanSubmitSequence() of the
+ * context records the uploads of all the flushed bindings in a single command buffer, submitted ahead of its own.
+ * Does nothing for host visible and coherent memory.
+ * @param culkan the Culkan instance
+ * @param binding the binding to flush
+ */
+void culkanFlushBinding(Culkan* culkan, uint32_t binding);
+
+/**
+ * @brief Makes the device writes to the memory of a binding visible to the host: downloads a device local binding to its staging
+ * buffer, and invalidates non-coherent memory. Does nothing for host visible and coherent memory.
+ * @param culkan the Culkan instance
+ * @param binding the binding to invalidate
+ */
+void culkanInvalidateBinding(Culkan* culkan, uint32_t binding);
+
+/**
+ * @brief Binds a binding to a host allocation, through VK_EXT_external_memory_host, so that the shader reads and writes it in place.
+ * The mapped memory of the binding is then the allocation, and culkanWriteBinding() and culkanReadBinding() on it copy nothing.
+ * The binding keeps its own memory when the device cannot import the allocation, they then copy it as before, so the callers
+ * do not need to know whether it was imported. CULKAN_HOST_IMPORT=0 disables the import, to test the copies.
+ * Waits for the last run of the instance, and the sequences that recorded it must be recorded again.
+ * The binding must not be imported while a sequence using it is pending.
+ * @param culkan the Culkan instance
+ * @param binding the binding to import the allocation as
+ * @param hostPointer the allocation, aligned on culkanGetHostImportAlignment() and spanning the size of the binding rounded up to it.
+ * It must outlive the instance, or be replaced by another import.
+ * @return whether the allocation was imported
+ */
+int culkanImportBinding(Culkan* culkan, uint32_t binding, void* hostPointer);
+
+/**
+ * @brief Gets the alignment of the pointers and sizes of the host allocations imported by culkanImportBinding()
+ * @param context the context of the instances
+ * @return the alignment in bytes, a power of two, or 0 if the device cannot import host allocations
+ */
+size_t culkanGetHostImportAlignment(CulkanContext* context);
+
+/**
+ * @brief Gets the size of the largest binding of a type that the device can bind, maxStorageBufferRange or maxUniformBufferRange.
+ * Creating or resizing a binding beyond it fails with BINDING_TOO_LARGE.
+ * @param context the context of the instances
+ * @param type the type of the binding
+ * @return the size in bytes
+ */
+size_t culkanGetMaxBindingSize(CulkanContext* context, CulkanBindingType type);
+
+/**
+ * @brief Gets the size of the memory heap that the buffers of a binding type are allocated from, which bounds the sum of the
+ * buffers of all the bindings of the type, device local memory for the storage buffers of the devices without unified memory.
+ * Their staging buffers are in another heap then.
+ * @param context the context of the instances
+ * @param type the type of the binding
+ * @return the size in bytes, or 0 if no memory type can hold the buffers
+ */
+size_t culkanGetBindingHeapSize(CulkanContext* context, CulkanBindingType type);
+
+/**
+ * @brief Resizes a binding, without creating the instance, its pipeline or its context again, so that an instance serves
+ * products of any size. The buffer is replaced by one of the new size from the memory pool of the context, which reuses the
+ * memory freed by the previous buffers, and the content of the binding is lost.
+ * Waits for the last run of the instance, and the sequences that recorded it must be recorded again.
+ * The binding must not be resized while a sequence using it is pending.
+ * @param culkan the Culkan instance
+ * @param binding the binding to resize
+ * @param size the new size of the binding, in bytes, at most culkanGetMaxBindingSize()
+ */
+void culkanResizeBinding(Culkan* culkan, uint32_t binding, size_t size);
+
+/**
+ * @brief Gets the memory reserved by the pool of a context and how much of it the buffers of its instances use
+ * @param context the context
+ * @return the number of blocks of the pool and their sizes
+ */
+CulkanMemoryPoolStats culkanGetMemoryPoolStats(CulkanContext* context);
+
 /**
  * @brief Initializes a Culkan instance. It allocates memory for the instance, so it should be freed after use by calling culkanDestroy()
  * @param layout the layout of the shader to use
@@ -254,6 +516,67 @@ void culkanReadBinding(Culkan* culkan, uint32_t binding, void* dst);
  */
 Culkan* culkanInit(const CulkanLayout* layout, const char* shaderPath, CulkanInvocations invocations);
 
+/**
+ * @brief Like culkanInit(), but with a SPIR-V module already in memory, for instance embedded in the binary at build time.
+ * The module is copied by culkanSetup(), so it only has to live until then.
+ * @param layout the layout of the shader to use
+ * @param spirv the SPIR-V words of the shader
+ * @param spirvSize the size of the SPIR-V module, in bytes
+ * @param invocations the number of invocations to use
+ * @return the created Culkan instance
+ */
+Culkan* culkanInitFromMemory(const CulkanLayout* layout, const uint32_t* spirv, size_t spirvSize, CulkanInvocations invocations);
+
+/**
+ * @brief Creates a context, the Vulkan instance, device, queue and pipeline cache that several Culkan instances can share.
+ * It should be freed after use by calling culkanDestroyContext(), once all its instances and sequences are destroyed.
+ * @return the created context
+ */
+CulkanContext* culkanCreateContext(void);
+
+/**
+ * @brief Frees a context created by culkanCreateContext(), and saves its pipeline cache
+ * @param context the context to free
+ */
+void culkanDestroyContext(CulkanContext* context);
+
+/**
+ * @brief Like culkanInitFromMemory(), but on a context shared with other instances rather than on a device of its own,
+ * so that their bindings can be used by the same sequences
+ * @param context the context to create the instance on, NULL to create one owned by the instance
+ * @param layout the layout of the shader to use
+ * @param spirv the SPIR-V words of the shader
+ * @param spirvSize the size of the SPIR-V module, in bytes
+ * @param invocations the number of invocations to use
+ * @return the created Culkan instance
+ */
+Culkan* culkanInitWithContext(CulkanContext* context, const CulkanLayout* layout, const uint32_t* spirv, size_t spirvSize,
+			      CulkanInvocations invocations);
+
+/**
+ * @brief Gets the context of a Culkan instance, to create other instances or sequences on it
+ * @param culkan the Culkan instance
+ * @return the context, owned by the instance if it was created by culkanInit() or culkanInitFromMemory()
+ */
+CulkanContext* culkanGetContext(Culkan* culkan);
+
+/**
+ * @brief Gets the features of the device of a context, to choose the variant of a shader that it runs best
+ * @param context the context
+ * @return whether the device runs shaders with doubles, and the size, operations and size control of its subgroups
+ */
+CulkanDeviceFeatures culkanGetDeviceFeatures(CulkanContext* context);
+
+/**
+ * @brief Path of the file persisting the pipeline cache of a device, so that the shaders compiled by the driver are reused
+ * by the next processes. The file is named after the vendor, device, driver version and pipeline cache UUID of the device,
+ * in CULKAN_PIPELINE_CACHE_DIR, else $XDG_CACHE_HOME/culkan, else $HOME/.cache/culkan.
+ * CULKAN_PIPELINE_CACHE=0 disables the persistence.
+ * @param culkan the Culkan instance of the device
+ * @return the path, owned by the context of the instance, or NULL if the pipeline cache is not persisted
+ */
+const char* culkanGetPipelineCachePath(Culkan* culkan);
+
 /**
  * @brief Sets up the Culkan instance.
  * Should be called after writing to the bindings and before running the shader
@@ -262,23 +585,193 @@ Culkan* culkanInit(const CulkanLayout* layout, const char* shaderPath, CulkanInv
 void culkanSetup(Culkan* culkan);
 
 /**
- * @brief Runs the shader of a Culkan instance. Should be called after setting up the instance.
+ * @brief Sets the number of workgroups dispatched by each run, (1, 1, 1) by default.
+ * Can be called before or after culkanSetup(), the command buffer is recorded again in the latter case.
+ * @param culkan the Culkan instance to set the grid of
+ * @param groupCount the number of workgroups along x, y and z, within the limits of the device
+ */
+void culkanSetGroupCount(Culkan* culkan, CulkanGroupCount groupCount);
+
+/**
+ * @brief Sets the push constants of the next runs, the scalars that change from a call to another.
+ * They are recorded in the command buffer, which is recorded again by the next submission, without any buffer or descriptor.
+ * @param culkan the Culkan instance to set the push constants of
+ * @param data the push constant block of the shader, pushConstantSize bytes of the layout, copied
+ */
+void culkanSetPushConstants(Culkan* culkan, const void* data);
+
+/**
+ * @brief Runs the shader of a Culkan instance and waits for it. Should be called after setting up the instance.
+ * Same as culkanWait(culkanSubmit(culkan)), nothing is allocated so it can be called in a loop.
  * @param culkan the Culkan instance to run
  */
 void culkanRun(Culkan* culkan);
 
+/**
+ * @brief Starts a run of the shader without waiting for it, so that the host can work in the meantime.
+ * An instance has a single command buffer, so a run still pending is waited for before the next one is submitted.
+ * The bindings must not be read or written until the run has been waited for.
+ * @param culkan the Culkan instance to run
+ * @return the handle to wait for the run with
+ */
+CulkanSubmission culkanSubmit(Culkan* culkan);
+
+/**
+ * @brief Whether a submitted run has completed, without blocking. It still has to be waited for with culkanWait().
+ * @param submission the handle returned by culkanSubmit()
+ * @return 1 if the run has completed, 0 otherwise
+ */
+int culkanIsComplete(CulkanSubmission submission);
+
+/**
+ * @brief Waits for a submitted run to complete, and resets its fence for the next run. Does nothing if it was already waited for.
+ * @param submission the handle returned by culkanSubmit()
+ */
+void culkanWait(CulkanSubmission submission);
+
 /**
  * @brief Frees the memory of a Culkan instance
  * @param culkan the Culkan instance to free the memory of
  */
 void culkanDestroy(Culkan* culkan);
 
+/**
+ * @brief Creates a sequence, a command buffer recording the dispatches of several instances of a context.
+ * It should be freed after use by calling culkanDestroySequence(), before the context.
+ * Its submissions signal the timeline semaphore of the context, or a fence of their own on devices without timeline semaphores.
+ * @param context the context of the instances to dispatch
+ * @return the created sequence
+ */
+CulkanSequence* culkanCreateSequence(CulkanContext* context);
+
+/**
+ * @brief Starts recording a sequence, discarding what it recorded before. Waits for its last submission if needed.
+ * @param sequence the sequence to record
+ */
+void culkanBeginSequence(CulkanSequence* sequence);
+
+/**
+ * @brief Records a dispatch of an instance set up by culkanSetup(), over its grid and with its current push constants.
+ * Setting the push constants or the grid afterwards does not change what was recorded.
+ * @param sequence the sequence being recorded
+ * @param culkan the Culkan instance to dispatch, on the context of the sequence
+ * @return NO_ERROR, or WRONG_CONTEXT, NOT_RECORDING or NOT_SET_UP without recording anything
+ */
+CulkanResult culkanSequenceDispatch(CulkanSequence* sequence, Culkan* culkan);
+
+/**
+ * @brief Records a barrier, so that the dispatches and copies recorded after it see the writes of the ones recorded before it.
+ * Without a barrier, the commands of a sequence may run concurrently.
+ * @param sequence the sequence being recorded
+ */
+void culkanSequenceBarrier(CulkanSequence* sequence);
+
+/**
+ * @brief Records a copy from a binding of an instance to a binding of another, to chain them without going through the host.
+ * The size copied is the smaller of the two bindings.
+ * @param sequence the sequence being recorded
+ * @param src the Culkan instance to copy from
+ * @param srcBinding the binding to copy from
+ * @param dst the Culkan instance to copy to
+ * @param dstBinding the binding to copy to
+ */
+void culkanSequenceCopyBinding(CulkanSequence* sequence, Culkan* src, uint32_t srcBinding, Culkan* dst, uint32_t dstBinding);
+
+/**
+ * @brief Records the upload of a range of a binding written by the host through culkanGetBindingPointer(), so that a sequence
+ * streams the data of its dispatches instead of culkanFlushBinding() uploading the whole binding.
+ * The range must be written before this call.
+ * Copies the range from the staging buffer of a device local binding, and only flushes non-coherent memory otherwise.
+ * A barrier is needed before a dispatch reads the range.
+ * @param sequence the sequence being recorded
+ * @param culkan the Culkan instance of the binding
+ * @param binding the binding to upload
+ * @param offset the offset of the range, in bytes
+ * @param size the size of the range, in bytes
+ */
+void culkanSequenceUpload(CulkanSequence* sequence, Culkan* culkan, uint32_t binding, size_t offset, size_t size);
+
+/**
+ * @brief Records the download of a range of a binding to its mapped memory, to be read by the host once the sequence
+ * has been waited for and culkanInvalidateMappedBinding() called. Copies the range to the staging buffer of a device local binding.
+ * A barrier is needed between the dispatch writing the range and the download.
+ * @param sequence the sequence being recorded
+ * @param culkan the Culkan instance of the binding
+ * @param binding the binding to download
+ * @param offset the offset of the range, in bytes
+ * @param size the size of the range, in bytes
+ */
+void culkanSequenceDownload(CulkanSequence* sequence, Culkan* culkan, uint32_t binding, size_t offset, size_t size);
+
+/**
+ * @brief Invalidates the host caches of the mapped memory of a binding, without downloading it like culkanInvalidateBinding().
+ * Does nothing for coherent memory.
+ * @param culkan the Culkan instance
+ * @param binding the binding to invalidate
+ */
+void culkanInvalidateMappedBinding(Culkan* culkan, uint32_t binding);
+
+/**
+ * @brief Ends the recording of a sequence. Called by culkanSubmitSequence() if needed.
+ * @param sequence the sequence being recorded
+ */
+void culkanEndSequence(CulkanSequence* sequence);
+
+/**
+ * @brief Submits all the commands recorded in a sequence at once. A sequence can be submitted again without being recorded again.
+ * As with culkanSubmit(), the bindings it uses must not be read or written until it has been waited for.
+ * The submission signals the next value of the timeline semaphore of the context, or the fence of the sequence without
+ * timeline semaphores, which culkanWait() waits for.
+ * @param sequence the sequence to submit
+ * @return the handle to wait for the sequence with culkanWait()
+ */
+CulkanSubmission culkanSubmitSequence(CulkanSequence* sequence);
+
+/**
+ * @brief Submits a sequence like culkanSubmitSequence(), to run on the device once the given submissions are complete.
+ * Sequences that depend on each other only through these waits have no barriers between them, so that the device may run
+ * the commands of a sequence while an unrelated one runs, such as the upload of a panel during the dispatch of the previous.
+ * The submissions of sequences are waited for by the device through the timeline semaphore, the others by the host before
+ * submitting, and all of them on devices without timeline semaphores.
+ * @param sequence the sequence to submit
+ * @param waits the submissions to wait for, of the context of the sequence
+ * @param waitCount the number of submissions in waits
+ * @return the handle to wait for the sequence with culkanWait()
+ */
+CulkanSubmission culkanSubmitSequenceAfter(CulkanSequence* sequence, const CulkanSubmission* waits, uint32_t waitCount);
+
+/**
+ * @brief Gets the last submission of a sequence, to wait for it or check it without keeping the handle of culkanSubmitSequence()
+ * @param sequence the sequence
+ * @return the handle of the last submission, already complete if the sequence was never submitted
+ */
+CulkanSubmission culkanGetSequenceSubmission(CulkanSequence* sequence);
+
+/**
+ * @brief Gets the device times of the commands of the last submission of a sequence, per stage, waiting for it if needed.
+ * The copies, dispatches, uploads and downloads are timed by timestamps written before and after them on the queue,
+ * so the times leave out the submission and the wait of the host. Uploads and downloads are only timed when they copy
+ * from or to a staging buffer. Commands of a stage may overlap without a barrier between them, their times are then summed.
+ * @param sequence the sequence, submitted at least once
+ * @param times the times of each stage, in seconds, all 0 if the queue cannot write timestamps
+ * @return whether the queue can write timestamps
+ */
+int culkanGetSequenceTimes(CulkanSequence* sequence, CulkanStageTimes* times);
+
+/**
+ * @brief Frees a sequence, after waiting for its last submission
+ * @param sequence the sequence to free
+ */
+void culkanDestroySequence(CulkanSequence* sequence);
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
 #include <vulkan/vk_enum_string_helper.h>
 #include <vulkan/vulkan_core.h>
 
@@ -294,6 +787,16 @@ const char* culkanErrCodeToString(CulkanErrCodes code) {
 			return "Too many invocations";
 		case NOT_ENOUGH_MEMORY:
 			return "Not enough memory";
+		case UNSUPPORTED_FEATURE:
+			return "Unsupported feature";
+		case WRONG_CONTEXT:
+			return "Instance of another context";
+		case NOT_RECORDING:
+			return "Sequence not recording";
+		case NOT_SET_UP:
+			return "Instance not set up";
+		case BINDING_TOO_LARGE:
+			return "Binding too large for the device";
 		default:
 			return "Unknown error";
 	}
@@ -340,7 +843,7 @@ VkWriteDescriptorSet* createDescriptorSetWrite(VkDescriptorSet descriptorSet, Vk
 	return descriptorWrite;
 }
 
-VkDescriptorBufferInfo* createDescriptorBufferInfo(VkBuffer buffer, uint32_t size) {
+VkDescriptorBufferInfo* createDescriptorBufferInfo(VkBuffer buffer, VkDeviceSize size) {
 	VkDescriptorBufferInfo* bufferInfo = culkanMalloc(VkDescriptorBufferInfo, 1);
 	*bufferInfo			   = (VkDescriptorBufferInfo){
 				   .buffer = buffer,
@@ -363,7 +866,7 @@ VkDescriptorSetLayoutBinding* createDescriptorSetLayoutBinding(uint32_t binding,
 	return layoutBinding;
 }
 
-VkBufferCreateInfo* createBufferCreateInfo(uint32_t size, VkBufferUsageFlags usage, uint32_t family) {
+VkBufferCreateInfo* createBufferCreateInfo(VkDeviceSize size, VkBufferUsageFlags usage, uint32_t family) {
 	VkBufferCreateInfo* bufferCreateInfo = culkanMalloc(VkBufferCreateInfo, 1);
 	*bufferCreateInfo		     = (VkBufferCreateInfo){
 			       .sType		      = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -414,100 +917,666 @@ uint32_t* culkanOpenShader(const char* filename, size_t* fileSize, Culkan* culka
 	return buffer;
 }
 
-void freeGPUVariableData(GPUVariable* variable) {
-	free(variable->bufferCreateInfoVar);
-	free(variable->vkBufferVar);
-	free(variable->layoutBindingVar);
-	free(variable->poolSizeVar);
-	free(variable->bufferInfoVar);
+VkBufferUsageFlags toVkBufferUsageFlags(CulkanBindingType type) {
+	switch (type) {
+		case STORAGE_BUFFER | OUTPUT_BUFFER:
+			return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+		case UNIFORM_BUFFER:
+			return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+		default:
+			return 0;
+	}
 }
 
-void freeGPUVariable(GPUVariable* variable) {
-	freeGPUVariableData(variable);
-	free(variable);
+// Rounds size up to a multiple of alignment, a power of two like all the alignments of Vulkan
+VkDeviceSize culkanAlignUp(VkDeviceSize size, VkDeviceSize alignment) {
+	return (size + alignment - 1) & ~(alignment - 1);
 }
 
-GPUVariable* createGPUVariable(size_t sizeOfVar, VkBufferUsageFlags usage, uint32_t binding, uint32_t family, VkDevice device,
-			       VkPhysicalDeviceMemoryProperties* memoryProperties, CulkanResult* result) {
-	GPUVariable* variable	      = culkanMalloc(GPUVariable, 1);
-	variable->bufferCreateInfoVar = createBufferCreateInfo(sizeOfVar, usage, family);
-	variable->vkBufferVar	      = createBuffer(device, variable->bufferCreateInfoVar);
-	variable->sizeOfVar	      = sizeOfVar;
-	variable->deviceVar	      = device;
-	vkGetBufferMemoryRequirements(device, *variable->vkBufferVar, &variable->memoryRequirementsVar);
-	variable->memoryAllocateInfoVar = (VkMemoryAllocateInfo){
+// Gives a range back to the free ranges of a block, merged with its free neighbours
+void culkanInsertFreeRange(CulkanMemoryBlock* block, VkDeviceSize offset, VkDeviceSize size) {
+	if (size == 0) {
+		return;
+	}
+	uint32_t i = 0;
+	while (i < block->freeCount && block->freeRanges[i].offset < offset) {
+		i++;
+	}
+	CulkanMemoryRange* previous = i > 0 ? &block->freeRanges[i - 1] : NULL;
+	CulkanMemoryRange* next	    = i < block->freeCount ? &block->freeRanges[i] : NULL;
+	int mergePrevious	    = previous != NULL && previous->offset + previous->size == offset;
+	int mergeNext		    = next != NULL && offset + size == next->offset;
+	if (mergePrevious && mergeNext) {
+		previous->size += size + next->size;
+		memmove(next, next + 1, (block->freeCount - i - 1) * sizeof(CulkanMemoryRange));
+		block->freeCount--;
+	}
+	else if (mergePrevious) {
+		previous->size += size;
+	}
+	else if (mergeNext) {
+		next->offset = offset;
+		next->size += size;
+	}
+	else {
+		if (block->freeCount == block->freeCapacity) {
+			block->freeCapacity *= 2;
+			block->freeRanges = (CulkanMemoryRange*)realloc(block->freeRanges, block->freeCapacity * sizeof(CulkanMemoryRange));
+			culkanCheckAllocation(block->freeRanges);
+		}
+		memmove(&block->freeRanges[i + 1], &block->freeRanges[i], (block->freeCount - i) * sizeof(CulkanMemoryRange));
+		block->freeRanges[i] = (CulkanMemoryRange){offset, size};
+		block->freeCount++;
+	}
+}
+
+// Takes size bytes aligned on alignment from the first free range of a block that has room for them
+int culkanTakeFromBlock(CulkanMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* offset) {
+	for (uint32_t i = 0; i < block->freeCount; i++) {
+		CulkanMemoryRange range = block->freeRanges[i];
+		VkDeviceSize start	= culkanAlignUp(range.offset, alignment);
+		if (start + size > range.offset + range.size) {
+			continue;
+		}
+		// The padding before the buffer and the rest of the range stay free
+		memmove(&block->freeRanges[i], &block->freeRanges[i + 1], (block->freeCount - i - 1) * sizeof(CulkanMemoryRange));
+		block->freeCount--;
+		culkanInsertFreeRange(block, range.offset, start - range.offset);
+		culkanInsertFreeRange(block, start + size, range.offset + range.size - start - size);
+		*offset = start;
+		block->allocationCount++;
+		return 1;
+	}
+	return 0;
+}
+
+// Allocates a block of size bytes of a memory type, or of minSize bytes if the device does not have size bytes left.
+// Returns NULL if it has neither.
+CulkanMemoryBlock* culkanCreateMemoryBlock(CulkanContext* context, uint32_t memoryTypeIndex, VkDeviceSize size, VkDeviceSize minSize) {
+	VkMemoryAllocateInfo allocateInfo = {
 	    .sType	     = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
 	    .pNext	     = NULL,
-	    .allocationSize  = variable->memoryRequirementsVar.size,
-	    .memoryTypeIndex = 0,
+	    .allocationSize  = size,
+	    .memoryTypeIndex = memoryTypeIndex,
 	};
-	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
-		if (variable->memoryRequirementsVar.memoryTypeBits & (1 << i) &&
-		    memoryProperties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
-			variable->memoryAllocateInfoVar.memoryTypeIndex = i;
-			break;
-		}
+	VkDeviceMemory memory;
+	VkResult allocated = vkAllocateMemory(context->device, &allocateInfo, NULL, &memory);
+	if (allocated != VK_SUCCESS && minSize < size) {
+		allocateInfo.allocationSize = minSize;
+		allocated		    = vkAllocateMemory(context->device, &allocateInfo, NULL, &memory);
+	}
+	if (allocated != VK_SUCCESS) {
+		return NULL;
 	}
-	result->vkResult = vkAllocateMemory(device, &variable->memoryAllocateInfoVar, NULL, &variable->deviceMemoryVar);
-	vkCheckError(result->vkResult);
-	result->vkResult = vkBindBufferMemory(device, *variable->vkBufferVar, variable->deviceMemoryVar, 0);
-	vkCheckError(result->vkResult);
 
-	variable->layoutBindingVar =
-	    createDescriptorSetLayoutBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
-	variable->poolSizeVar	= createDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1);
-	variable->bufferInfoVar = createDescriptorBufferInfo(*variable->vkBufferVar, variable->sizeOfVar);
+	CulkanMemoryBlock* block = culkanMalloc(CulkanMemoryBlock, 1);
+	block->memory		 = memory;
+	block->memoryTypeIndex	 = memoryTypeIndex;
+	block->size		 = allocateInfo.allocationSize;
+	block->mapped		 = NULL;
+	block->freeCapacity	 = 8;
+	block->freeRanges	 = culkanMalloc(CulkanMemoryRange, block->freeCapacity);
+	block->freeRanges[0]	 = (CulkanMemoryRange){0, block->size};
+	block->freeCount	 = 1;
+	block->allocationCount	 = 0;
+	block->next		 = context->memoryBlocks;
+	context->memoryBlocks	 = block;
+
+	// Mapped once, mapping is not free and a buffer can be written many times
+	if (context->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+		context->result.vkResult = vkMapMemory(context->device, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+		culkanCheckError(context);
+	}
+	return block;
+}
 
-	return variable;
+void culkanDestroyMemoryBlock(CulkanContext* context, CulkanMemoryBlock* block) {
+	CulkanMemoryBlock** link = &context->memoryBlocks;
+	while (*link != block) {
+		link = &(*link)->next;
+	}
+	*link = block->next;
+	if (block->mapped != NULL) {
+		vkUnmapMemory(context->device, block->memory);
+	}
+	vkFreeMemory(context->device, block->memory, NULL);
+	free(block->freeRanges);
+	free(block);
 }
 
-GPUVariable* culkanGetBinding(Culkan* culkan, uint32_t binding) {
-	if (binding >= culkan->layout->bindingCount) {
-		culkan->result = (CulkanResult){VK_ERROR_UNKNOWN, OUT_OF_BOUNDS_BINDING};
-		culkanCheckError(culkan);
+/**
+ * @brief Suballocates the memory of a buffer from the blocks of a memory type of the context, allocating a block if none has room
+ * @return the allocation, whose block is NULL if the device is out of memory
+ */
+CulkanAllocation culkanPoolAllocate(CulkanContext* context, VkMemoryRequirements requirements, uint32_t memoryTypeIndex) {
+	VkDeviceSize atom	    = context->deviceProperties.limits.nonCoherentAtomSize;
+	VkDeviceSize alignment	    = requirements.alignment > atom ? requirements.alignment : atom;
+	CulkanAllocation allocation = {.block = NULL, .offset = 0, .size = culkanAlignUp(requirements.size, atom)};
+
+	for (CulkanMemoryBlock* block = context->memoryBlocks; block != NULL; block = block->next) {
+		if (block->memoryTypeIndex != memoryTypeIndex) {
+			continue;
+		}
+		if (culkanTakeFromBlock(block, allocation.size, alignment, &allocation.offset)) {
+			allocation.block = block;
+			return allocation;
+		}
 	}
-	return &culkan->variables[binding];
+
+	VkDeviceSize blockSize = allocation.size > CULKAN_MEMORY_BLOCK_SIZE ? allocation.size : CULKAN_MEMORY_BLOCK_SIZE;
+	allocation.block       = culkanCreateMemoryBlock(context, memoryTypeIndex, blockSize, allocation.size);
+	if (allocation.block != NULL) {
+		culkanTakeFromBlock(allocation.block, allocation.size, alignment, &allocation.offset);
+	}
+	return allocation;
 }
 
-void culkanWriteGPUVariable(GPUVariable* variable, const void* src, CulkanResult* result) {
-	result->vkResult = vkMapMemory(variable->deviceVar, variable->deviceMemoryVar, 0, VK_WHOLE_SIZE, 0, &variable->dataVar);
-	vkCheckError(result->vkResult);
-	memcpy(variable->dataVar, src, variable->sizeOfVar);
-	vkUnmapMemory(variable->deviceVar, variable->deviceMemoryVar);
+// Gives the memory of a buffer back to its block
+void culkanPoolFree(CulkanContext* context, CulkanAllocation allocation) {
+	CulkanMemoryBlock* block = allocation.block;
+	if (block == NULL) {
+		return;
+	}
+	culkanInsertFreeRange(block, allocation.offset, allocation.size);
+	block->allocationCount--;
+	// The blocks of the pool are kept for the next buffers, a block of a single large buffer is released with it
+	if (block->allocationCount == 0 && block->size > CULKAN_MEMORY_BLOCK_SIZE) {
+		culkanDestroyMemoryBlock(context, block);
+	}
 }
 
-void culkanWriteBinding(Culkan* culkan, uint32_t binding, const void* src) {
-	if (binding >= culkan->layout->bindingCount) {
-		culkan->result = (CulkanResult){VK_ERROR_UNKNOWN, OUT_OF_BOUNDS_BINDING};
+// Waits for the uploads submitted by culkanSubmitUploads(), before the transfer command buffer is recorded again
+void culkanWaitTransfer(CulkanContext* context) {
+	if (!context->transferPending) {
 		return;
 	}
-	culkanWriteGPUVariable(&culkan->variables[binding], src, &culkan->result);
+	context->result.vkResult = vkWaitForFences(context->device, 1, &context->transferFence, VK_TRUE, UINT64_MAX);
+	culkanCheckError(context);
+	context->result.vkResult = vkResetFences(context->device, 1, &context->transferFence);
+	culkanCheckError(context);
+	context->transferPending = 0;
 }
 
-void culkanReadGPUVariable(GPUVariable* variable, void* dst, CulkanResult* result) {
-	result->vkResult = vkMapMemory(variable->deviceVar, variable->deviceMemoryVar, 0, VK_WHOLE_SIZE, 0, &variable->dataVar);
-	vkCheckError(result->vkResult);
-	memcpy(dst, variable->dataVar, variable->sizeOfVar);
-	vkUnmapMemory(variable->deviceVar, variable->deviceMemoryVar);
+// Removes a variable from the pending uploads of its context, when its buffers are freed
+void culkanCancelUpload(GPUVariable* variable) {
+	CulkanContext* context = variable->contextVar;
+	if (!variable->uploadPendingVar) {
+		return;
+	}
+	for (uint32_t i = 0; i < context->pendingUploadCount; i++) {
+		if (context->pendingUploads[i] == variable) {
+			context->pendingUploads[i] = context->pendingUploads[--context->pendingUploadCount];
+			break;
+		}
+	}
+	variable->uploadPendingVar = 0;
 }
 
-void culkanReadBinding(Culkan* culkan, uint32_t binding, void* dst) {
-	if (binding >= culkan->layout->bindingCount) {
-		culkan->result = (CulkanResult){VK_ERROR_UNKNOWN, OUT_OF_BOUNDS_BINDING};
-		culkanCheckError(culkan);
+// Frees the buffers and the memory of a variable, which an imported host allocation or a resize replaces
+void freeGPUVariableMemory(GPUVariable* variable) {
+	// The submitted uploads may still read the buffers, the pending ones must not
+	culkanWaitTransfer(variable->contextVar);
+	culkanCancelUpload(variable);
+	if (variable->stagingBufferVar != VK_NULL_HANDLE) {
+		vkDestroyBuffer(variable->deviceVar, variable->stagingBufferVar, NULL);
+		culkanPoolFree(variable->contextVar, variable->stagingAllocationVar);
+	}
+	vkDestroyBuffer(variable->deviceVar, *variable->vkBufferVar, NULL);
+	if (variable->importedVar != NULL) {
+		vkFreeMemory(variable->deviceVar, variable->deviceMemoryVar, NULL);
+	}
+	else {
+		culkanPoolFree(variable->contextVar, variable->allocationVar);
 	}
-	culkanReadGPUVariable(&culkan->variables[binding], dst, &culkan->result);
 }
 
-VkBufferUsageFlags toVkBufferUsageFlags(CulkanBindingType type) {
-	switch (type) {
-		case STORAGE_BUFFER | OUTPUT_BUFFER:
-			return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-		case UNIFORM_BUFFER:
-			return VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-		default:
-			return 0;
+void freeGPUVariableData(GPUVariable* variable) {
+	freeGPUVariableMemory(variable);
+	free(variable->bufferCreateInfoVar);
+	free(variable->vkBufferVar);
+	free(variable->layoutBindingVar);
+	free(variable->poolSizeVar);
+	free(variable->bufferInfoVar);
+}
+
+void freeGPUVariable(GPUVariable* variable) {
+	freeGPUVariableData(variable);
+	free(variable);
+}
+
+/**
+ * @brief Scores a memory type for an allocation
+ * @param flags the property flags of the memory type
+ * @param required the flags the memory type must have
+ * @param preferred the flags that make a memory type better, each of them counts twice as much as an avoided one
+ * @param avoided the flags that make a memory type worse
+ * @return the score, higher is better, or -1 if the memory type lacks a required flag
+ */
+int32_t culkanScoreMemoryType(VkMemoryPropertyFlags flags, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+			      VkMemoryPropertyFlags avoided) {
+	if ((flags & required) != required) {
+		return -1;
+	}
+	int32_t score = 0;
+	for (uint32_t bit = 0; bit < 32; bit++) {
+		VkMemoryPropertyFlags flag = 1U << bit;
+		if (flags & flag & preferred) {
+			score += 2;
+		}
+		if (flags & flag & avoided) {
+			score -= 1;
+		}
+	}
+	// The scores are shifted so that a type with only avoided flags is still valid
+	return score + 32;
+}
+
+/**
+ * @brief Finds the memory type with the best score among the ones allowed by memoryTypeBits
+ * @return the index of the memory type, or UINT32_MAX if none has the required flags
+ */
+uint32_t culkanFindMemoryType(VkPhysicalDeviceMemoryProperties* memoryProperties, uint32_t memoryTypeBits, VkMemoryPropertyFlags required,
+			      VkMemoryPropertyFlags preferred, VkMemoryPropertyFlags avoided) {
+	uint32_t best	   = UINT32_MAX;
+	int32_t best_score = -1;
+	for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+		if (!(memoryTypeBits & (1U << i))) {
+			continue;
+		}
+		int32_t score = culkanScoreMemoryType(memoryProperties->memoryTypes[i].propertyFlags, required, preferred, avoided);
+		if (score > best_score) {
+			best	   = i;
+			best_score = score;
+		}
+	}
+	return best;
+}
+
+/**
+ * @brief Whether the device shares its memory with the host (integrated GPU or CPU implementation such as lavapipe),
+ * in which case staging copies only add work. The CULKAN_FORCE_STAGING environment variable disables it, to test the staging path.
+ */
+int culkanHasUnifiedMemory(CulkanContext* context) {
+	const char* forceStaging = getenv("CULKAN_FORCE_STAGING");
+	if (forceStaging != NULL && strcmp(forceStaging, "0") != 0) {
+		return 0;
+	}
+	return context->deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+	       context->deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_CPU;
+}
+
+// Whether the physical device of a context supports a device extension
+int culkanHasDeviceExtension(CulkanContext* context, const char* name) {
+	uint32_t count		 = 0;
+	context->result.vkResult = vkEnumerateDeviceExtensionProperties(context->physicalDevice, NULL, &count, NULL);
+	culkanCheckError(context);
+	VkExtensionProperties* extensions = culkanMalloc(VkExtensionProperties, count);
+	context->result.vkResult	  = vkEnumerateDeviceExtensionProperties(context->physicalDevice, NULL, &count, extensions);
+	culkanCheckError(context);
+	int found = 0;
+	for (uint32_t i = 0; i < count && !found; i++) {
+		found = strcmp(extensions[i].extensionName, name) == 0;
+	}
+	free(extensions);
+	return found;
+}
+
+// Allocates a primary command buffer from the pool of the context
+VkCommandBuffer culkanAllocateCommandBuffer(CulkanContext* context) {
+	VkCommandBufferAllocateInfo allocateInfo = {
+	    .sType		= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+	    .pNext		= NULL,
+	    .commandPool	= context->commandPool,
+	    .level		= VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+	    .commandBufferCount = 1,
+	};
+	VkCommandBuffer commandBuffer;
+	context->result.vkResult = vkAllocateCommandBuffers(context->device, &allocateInfo, &commandBuffer);
+	culkanCheckError(context);
+	return commandBuffer;
+}
+
+// Creates an unsignaled fence
+VkFence culkanCreateFence(CulkanContext* context) {
+	VkFenceCreateInfo fenceCreateInfo = {
+	    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+	    .pNext = NULL,
+	    .flags = 0,
+	};
+	VkFence fence;
+	context->result.vkResult = vkCreateFence(context->device, &fenceCreateInfo, NULL, &fence);
+	culkanCheckError(context);
+	return fence;
+}
+
+// Submits a command buffer alone, signaling fence
+void culkanSubmitCommandBuffer(CulkanContext* context, VkCommandBuffer commandBuffer, VkFence fence) {
+	VkSubmitInfo submitInfo = {
+	    .sType		  = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+	    .pNext		  = NULL,
+	    .waitSemaphoreCount	  = 0,
+	    .pWaitSemaphores	  = NULL,
+	    .pWaitDstStageMask	  = NULL,
+	    .commandBufferCount	  = 1,
+	    .pCommandBuffers	  = &commandBuffer,
+	    .signalSemaphoreCount = 0,
+	    .pSignalSemaphores	  = NULL,
+	};
+
+	context->result.vkResult = vkQueueSubmit(context->queue, 1, &submitInfo, fence);
+	culkanCheckError(context);
+}
+
+// Records a global memory barrier in a command buffer
+void culkanRecordMemoryBarrier(VkCommandBuffer commandBuffer, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+			       VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+	VkMemoryBarrier barrier = {
+	    .sType	   = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+	    .pNext	   = NULL,
+	    .srcAccessMask = srcAccess,
+	    .dstAccessMask = dstAccess,
+	};
+	vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+// Begins the transfer command buffer of a context, once the uploads it was last submitted with are done
+void culkanBeginTransfer(CulkanContext* context) {
+	culkanWaitTransfer(context);
+	context->result.vkResult = vkResetCommandBuffer(context->transferCommandBuffer, 0);
+	culkanCheckError(context);
+	VkCommandBufferBeginInfo beginInfo = {
+	    .sType	      = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+	    .pNext	      = NULL,
+	    .flags	      = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	    .pInheritanceInfo = NULL,
+	};
+	context->result.vkResult = vkBeginCommandBuffer(context->transferCommandBuffer, &beginInfo);
+	culkanCheckError(context);
+}
+
+// Copies size bytes of a device buffer written by the shaders to a host visible buffer, and waits for the copy
+void culkanCopyBuffer(CulkanContext* context, VkBuffer src, VkBuffer dst, VkDeviceSize size) {
+	culkanBeginTransfer(context);
+	VkCommandBuffer commandBuffer = context->transferCommandBuffer;
+	culkanRecordMemoryBarrier(commandBuffer,
+				  VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				  VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+				  VK_PIPELINE_STAGE_TRANSFER_BIT,
+				  VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+	VkBufferCopy region = {.srcOffset = 0, .dstOffset = 0, .size = size};
+	vkCmdCopyBuffer(commandBuffer, src, dst, 1, &region);
+	// The fence only orders the host after the copy, the barrier makes its writes visible to the host
+	culkanRecordMemoryBarrier(commandBuffer,
+				  VK_PIPELINE_STAGE_TRANSFER_BIT,
+				  VK_ACCESS_TRANSFER_WRITE_BIT,
+				  VK_PIPELINE_STAGE_HOST_BIT,
+				  VK_ACCESS_HOST_READ_BIT);
+	context->result.vkResult = vkEndCommandBuffer(commandBuffer);
+	culkanCheckError(context);
+
+	culkanSubmitCommandBuffer(context, commandBuffer, context->transferFence);
+	context->transferPending = 1;
+	culkanWaitTransfer(context);
+}
+
+// Adds a flushed staging buffer to the uploads of the next submission of its context, once
+void culkanQueueUpload(GPUVariable* variable) {
+	CulkanContext* context = variable->contextVar;
+	if (variable->uploadPendingVar) {
+		return;
+	}
+	if (context->pendingUploadCount == context->pendingUploadCapacity) {
+		context->pendingUploadCapacity = context->pendingUploadCapacity == 0 ? 8 : 2 * context->pendingUploadCapacity;
+		context->pendingUploads =
+		    (GPUVariable**)realloc(context->pendingUploads, context->pendingUploadCapacity * sizeof(GPUVariable*));
+		culkanCheckAllocation(context->pendingUploads);
+	}
+	context->pendingUploads[context->pendingUploadCount++] = variable;
+	variable->uploadPendingVar			       = 1;
+}
+
+/**
+ * @brief Submits the uploads of all the staging buffers flushed since the last submission, in a single command buffer and
+ * without waiting for them. The copies wait for the shaders and copies submitted before them, which may still use the device
+ * buffers, and the barrier after them makes them visible to the ones submitted next, which run after them in submission order.
+ */
+void culkanSubmitUploads(CulkanContext* context) {
+	if (context->pendingUploadCount == 0) {
+		return;
+	}
+	culkanBeginTransfer(context);
+	VkCommandBuffer commandBuffer = context->transferCommandBuffer;
+	VkPipelineStageFlags stages   = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkAccessFlags writes	      = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkAccessFlags accesses	      = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | writes;
+	culkanRecordMemoryBarrier(commandBuffer, stages, writes, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT);
+	for (uint32_t i = 0; i < context->pendingUploadCount; i++) {
+		GPUVariable* variable = context->pendingUploads[i];
+		VkBufferCopy region   = {.srcOffset = 0, .dstOffset = 0, .size = variable->sizeOfVar};
+		vkCmdCopyBuffer(commandBuffer, variable->stagingBufferVar, *variable->vkBufferVar, 1, &region);
+		variable->uploadPendingVar = 0;
+	}
+	context->pendingUploadCount = 0;
+	culkanRecordMemoryBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, stages, accesses);
+	context->result.vkResult = vkEndCommandBuffer(commandBuffer);
+	culkanCheckError(context);
+
+	culkanSubmitCommandBuffer(context, commandBuffer, context->transferFence);
+	context->transferPending = 1;
+}
+
+/**
+ * @brief Chooses the memory type of the buffers of a binding type, among the ones allowed by memoryTypeBits.
+ * Device local memory that the host cannot see for the storage buffers of the devices without unified memory, else
+ * host visible memory.
+ * @return the index of the memory type, or UINT32_MAX if none is host visible
+ */
+uint32_t culkanChooseMemoryType(CulkanContext* context, CulkanBindingType type, uint32_t memoryTypeBits) {
+	VkPhysicalDeviceMemoryProperties* memoryProperties = &context->memoryProperties;
+	if (type != UNIFORM_BUFFER && !culkanHasUnifiedMemory(context)) {
+		// Plain device memory rather than the small host visible window some devices expose
+		uint32_t memoryTypeIndex = culkanFindMemoryType(
+		    memoryProperties, memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+		if (memoryTypeIndex != UINT32_MAX &&
+		    !(memoryProperties->memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+			return memoryTypeIndex;
+		}
+	}
+	// Written in place by the host, device local memory first when the host can see it (unified memory, resizable BAR)
+	return culkanFindMemoryType(memoryProperties,
+				    memoryTypeBits,
+				    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+				    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+				    0);
+}
+
+/**
+ * @brief Creates a variable for a binding.
+ * Uniform buffers and the storage buffers of unified memory devices are host visible and written in place.
+ * The storage buffers of the other devices are device local, and go through a host visible staging buffer.
+ */
+GPUVariable* createGPUVariable(Culkan* culkan, size_t sizeOfVar, CulkanBindingType type, uint32_t binding) {
+	VkDevice device					   = culkan->context->device;
+	VkPhysicalDeviceMemoryProperties* memoryProperties = &culkan->context->memoryProperties;
+	CulkanResult* result				   = &culkan->result;
+
+	// The descriptor range, and so the binding, cannot go beyond the limit of the device
+	if (sizeOfVar > culkanGetMaxBindingSize(culkan->context, type)) {
+		result->ckResult = BINDING_TOO_LARGE;
+		culkanCheckErrorWithMessage(culkan, "Binding larger than the buffer range of the device");
+	}
+
+	// Any buffer may be copied, by the staging copies or by culkanSequenceCopyBinding()
+	VkBufferUsageFlags usage = toVkBufferUsageFlags(type) | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+	GPUVariable* variable	       = culkanMalloc(GPUVariable, 1);
+	variable->bufferCreateInfoVar  = createBufferCreateInfo(sizeOfVar, usage, culkan->context->family);
+	variable->vkBufferVar	       = createBuffer(device, variable->bufferCreateInfoVar);
+	variable->sizeOfVar	       = sizeOfVar;
+	variable->deviceVar	       = device;
+	variable->stagingBufferVar     = VK_NULL_HANDLE;
+	variable->stagingMemoryVar     = VK_NULL_HANDLE;
+	variable->stagingAllocationVar = (CulkanAllocation){.block = NULL, .offset = 0, .size = 0};
+	variable->contextVar	       = culkan->context;
+	variable->uploadPendingVar     = 0;
+	variable->importedVar	       = NULL;
+	vkGetBufferMemoryRequirements(device, *variable->vkBufferVar, &variable->memoryRequirementsVar);
+
+	uint32_t memoryTypeIndex = culkanChooseMemoryType(culkan->context, type, variable->memoryRequirementsVar.memoryTypeBits);
+	if (memoryTypeIndex == UINT32_MAX) {
+		result->ckResult = NOT_ENOUGH_MEMORY;
+		culkanCheckErrorWithMessage(culkan, "No memory type for the buffer");
+	}
+	int deviceLocal = !(memoryProperties->memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+
+	// Suballocated from the memory pool of the context, rather than an allocation per buffer
+	variable->memoryPropertyFlagsVar = memoryProperties->memoryTypes[memoryTypeIndex].propertyFlags;
+	variable->allocationVar		 = culkanPoolAllocate(culkan->context, variable->memoryRequirementsVar, memoryTypeIndex);
+	if (variable->allocationVar.block == NULL) {
+		result->ckResult = NOT_ENOUGH_MEMORY;
+		culkanCheckErrorWithMessage(culkan, "No device memory left for the buffer");
+	}
+	variable->deviceMemoryVar = variable->allocationVar.block->memory;
+	result->vkResult =
+	    vkBindBufferMemory(device, *variable->vkBufferVar, variable->deviceMemoryVar, variable->allocationVar.offset);
+	vkCheckError(result->vkResult);
+
+	CulkanAllocation* mappedAllocation = &variable->allocationVar;
+	if (deviceLocal) {
+		VkBufferCreateInfo* stagingCreateInfo = createBufferCreateInfo(
+		    sizeOfVar, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, culkan->context->family);
+		result->vkResult = vkCreateBuffer(device, stagingCreateInfo, NULL, &variable->stagingBufferVar);
+		vkCheckError(result->vkResult);
+		free(stagingCreateInfo);
+
+		VkMemoryRequirements stagingRequirements;
+		vkGetBufferMemoryRequirements(device, variable->stagingBufferVar, &stagingRequirements);
+		// Cached memory makes the reads of the results fast
+		uint32_t stagingTypeIndex = culkanFindMemoryType(memoryProperties,
+								 stagingRequirements.memoryTypeBits,
+								 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+								 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+								 0);
+		if (stagingTypeIndex == UINT32_MAX) {
+			result->ckResult = NOT_ENOUGH_MEMORY;
+			culkanCheckErrorWithMessage(culkan, "No host visible memory type for the staging buffer");
+		}
+		variable->stagingMemoryPropertyFlagsVar = memoryProperties->memoryTypes[stagingTypeIndex].propertyFlags;
+		variable->stagingAllocationVar		= culkanPoolAllocate(culkan->context, stagingRequirements, stagingTypeIndex);
+		if (variable->stagingAllocationVar.block == NULL) {
+			result->ckResult = NOT_ENOUGH_MEMORY;
+			culkanCheckErrorWithMessage(culkan, "No host visible memory left for the staging buffer");
+		}
+		variable->stagingMemoryVar = variable->stagingAllocationVar.block->memory;
+		result->vkResult	   = vkBindBufferMemory(
+		    device, variable->stagingBufferVar, variable->stagingMemoryVar, variable->stagingAllocationVar.offset);
+		vkCheckError(result->vkResult);
+		mappedAllocation = &variable->stagingAllocationVar;
+	}
+
+	// The blocks of host visible memory are mapped once for their lifetime
+	variable->dataVar = (char*)mappedAllocation->block->mapped + mappedAllocation->offset;
+
+	variable->layoutBindingVar =
+	    createDescriptorSetLayoutBinding(binding, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT);
+	variable->poolSizeVar	= createDescriptorPoolSize(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1);
+	variable->bufferInfoVar = createDescriptorBufferInfo(*variable->vkBufferVar, variable->sizeOfVar);
+
+	return variable;
+}
+
+GPUVariable* culkanGetBinding(Culkan* culkan, uint32_t binding) {
+	if (binding >= culkan->layout->bindingCount) {
+		culkan->result = (CulkanResult){VK_ERROR_UNKNOWN, OUT_OF_BOUNDS_BINDING};
+		culkanCheckError(culkan);
+	}
+	return &culkan->variables[binding];
+}
+
+// Range of the whole mapped memory of a variable, for flushes and invalidations, aligned on nonCoherentAtomSize by the memory pool
+VkMappedMemoryRange culkanWholeRange(GPUVariable* variable) {
+	int staged		     = variable->stagingBufferVar != VK_NULL_HANDLE;
+	CulkanAllocation* allocation = staged ? &variable->stagingAllocationVar : &variable->allocationVar;
+	return (VkMappedMemoryRange){
+	    .sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+	    .pNext  = NULL,
+	    .memory = allocation->block->memory,
+	    .offset = allocation->offset,
+	    .size   = allocation->size,
+	};
+}
+
+// Whether the mapped memory of a variable needs explicit flushes and invalidations
+int culkanIsMappedMemoryCoherent(GPUVariable* variable) {
+	VkMemoryPropertyFlags flags =
+	    variable->stagingBufferVar != VK_NULL_HANDLE ? variable->stagingMemoryPropertyFlagsVar : variable->memoryPropertyFlagsVar;
+	return (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+}
+
+void culkanFlushGPUVariable(GPUVariable* variable, CulkanResult* result) {
+	if (!culkanIsMappedMemoryCoherent(variable)) {
+		VkMappedMemoryRange range = culkanWholeRange(variable);
+		result->vkResult	  = vkFlushMappedMemoryRanges(variable->deviceVar, 1, &range);
+		vkCheckError(result->vkResult);
+	}
+	if (variable->stagingBufferVar != VK_NULL_HANDLE) {
+		culkanQueueUpload(variable);
+	}
+}
+
+void culkanInvalidateGPUVariable(GPUVariable* variable, CulkanResult* result) {
+	// A staging buffer flushed since the last submission holds newer data than the device buffer
+	if (variable->stagingBufferVar != VK_NULL_HANDLE && !variable->uploadPendingVar) {
+		culkanCopyBuffer(variable->contextVar, *variable->vkBufferVar, variable->stagingBufferVar, variable->sizeOfVar);
+	}
+	if (!culkanIsMappedMemoryCoherent(variable)) {
+		VkMappedMemoryRange range = culkanWholeRange(variable);
+		result->vkResult	  = vkInvalidateMappedMemoryRanges(variable->deviceVar, 1, &range);
+		vkCheckError(result->vkResult);
+	}
+}
+
+void culkanWriteGPUVariable(GPUVariable* variable, const void* src, CulkanResult* result) {
+	// Nothing to copy from the host allocation imported as the variable
+	if (src != variable->dataVar) {
+		memcpy(variable->dataVar, src, variable->sizeOfVar);
+	}
+	culkanFlushGPUVariable(variable, result);
+}
+
+void culkanWriteBinding(Culkan* culkan, uint32_t binding, const void* src) {
+	if (binding >= culkan->layout->bindingCount) {
+		culkan->result = (CulkanResult){VK_ERROR_UNKNOWN, OUT_OF_BOUNDS_BINDING};
+		return;
+	}
+	culkanWriteGPUVariable(&culkan->variables[binding], src, &culkan->result);
+}
+
+void culkanReadGPUVariable(GPUVariable* variable, void* dst, CulkanResult* result) {
+	culkanInvalidateGPUVariable(variable, result);
+	if (dst != variable->dataVar) {
+		memcpy(dst, variable->dataVar, variable->sizeOfVar);
+	}
+}
+
+void culkanReadBinding(Culkan* culkan, uint32_t binding, void* dst) {
+	if (binding >= culkan->layout->bindingCount) {
+		culkan->result = (CulkanResult){VK_ERROR_UNKNOWN, OUT_OF_BOUNDS_BINDING};
+		culkanCheckError(culkan);
 	}
+	culkanReadGPUVariable(&culkan->variables[binding], dst, &culkan->result);
+}
+
+void* culkanGetBindingPointer(Culkan* culkan, uint32_t binding) {
+	return culkanGetBinding(culkan, binding)->dataVar;
+}
+
+void culkanFlushBinding(Culkan* culkan, uint32_t binding) {
+	culkanFlushGPUVariable(culkanGetBinding(culkan, binding), &culkan->result);
+}
+
+void culkanInvalidateBinding(Culkan* culkan, uint32_t binding) {
+	culkanInvalidateGPUVariable(culkanGetBinding(culkan, binding), &culkan->result);
 }
 
 // Allocate all the memory needed for the variables and bindings
@@ -515,72 +1584,228 @@ void culkanGPUAlloc(Culkan* culkan) {
 	culkan->variables = culkanMalloc(GPUVariable, culkan->layout->bindingCount);
 
 	for (uint32_t binding_idx = 0; binding_idx < culkan->layout->bindingCount; binding_idx++) {
-		VkBufferUsageFlags usage       = toVkBufferUsageFlags(culkan->layout->bindings[binding_idx].type);
-		culkan->variables[binding_idx] = *createGPUVariable(culkan->layout->bindings[binding_idx].size,
-								    usage,
-								    binding_idx,
-								    culkan->family,
-								    culkan->device,
-								    &culkan->memoryProperties,
-								    &culkan->result);
+		GPUVariable* variable = createGPUVariable(
+		    culkan, culkan->layout->bindings[binding_idx].size, culkan->layout->bindings[binding_idx].type, binding_idx);
+		culkan->variables[binding_idx] = *variable;
+		free(variable);
 	}
 }
 
-void culkanGetPhysicalDevices(Culkan* culkan) {
-	culkan->result.vkResult = vkEnumeratePhysicalDevices(culkan->instance, &culkan->physicalDeviceCount, NULL);
-	culkanCheckError(culkan);
+void culkanGetPhysicalDevices(CulkanContext* context) {
+	context->result.vkResult = vkEnumeratePhysicalDevices(context->instance, &context->physicalDeviceCount, NULL);
+	culkanCheckError(context);
 
-	culkan->physicalDevices = culkanMalloc(VkPhysicalDevice, culkan->physicalDeviceCount);
+	context->physicalDevices = culkanMalloc(VkPhysicalDevice, context->physicalDeviceCount);
 
-	culkan->result.vkResult = vkEnumeratePhysicalDevices(culkan->instance, &culkan->physicalDeviceCount, culkan->physicalDevices);
-	culkanCheckError(culkan);
+	context->result.vkResult = vkEnumeratePhysicalDevices(context->instance, &context->physicalDeviceCount, context->physicalDevices);
+	culkanCheckError(context);
 
-	culkan->physicalDevice = culkan->physicalDevices[0];
+	context->physicalDevice = context->physicalDevices[0];
 }
 
+// Checks the bindings against the buffer range of the device, and their buffers and staging buffers against the heaps of the
+// memory types chosen for them, summed over the bindings of the instance
 void culkanCheckForEnoughMemory(Culkan* culkan) {
-	uint32_t heap_idx;
-	for (heap_idx = 0; heap_idx < culkan->memoryProperties.memoryHeapCount; heap_idx++) {
-		int is_heap_big_enough = 1;
-		for (uint32_t binding_idx = 0; binding_idx < culkan->layout->bindingCount; binding_idx++) {
-			if (culkan->memoryProperties.memoryHeaps[heap_idx].size <
-			    culkan->variables[binding_idx].memoryRequirementsVar.size) {
-				is_heap_big_enough = 0;
-				break;
-			}
-		}
-		if (!is_heap_big_enough) {
-			culkan->result.ckResult = NOT_ENOUGH_MEMORY;
-			char message[256];
+	VkPhysicalDeviceMemoryProperties* memoryProperties = &culkan->context->memoryProperties;
+	VkDeviceSize heapSizes[VK_MAX_MEMORY_HEAPS]	   = {0};
+	for (uint32_t binding = 0; binding < culkan->layout->bindingCount; binding++) {
+		GPUVariable* variable = &culkan->variables[binding];
+		size_t maxSize	      = culkanGetMaxBindingSize(culkan->context, culkan->layout->bindings[binding].type);
+		if (variable->sizeOfVar > maxSize) {
+			culkan->result.ckResult = BINDING_TOO_LARGE;
+			char message[128];
 			sprintf(message,
-				"Heap %d is not big enough : Requested %lu, available %lu",
-				heap_idx,
-				culkan->variables[heap_idx].memoryRequirementsVar.size,
-				culkan->memoryProperties.memoryHeaps[heap_idx].size);
+				"Binding %u: requested %llu bytes, buffer range of the device %llu",
+				binding,
+				(unsigned long long)variable->sizeOfVar,
+				(unsigned long long)maxSize);
+			culkanCheckErrorWithMessage(culkan, message);
+			return;
+		}
+
+		const CulkanAllocation* allocations[2] = {&variable->allocationVar, &variable->stagingAllocationVar};
+		for (int i = 0; i < 2; i++) {
+			if (allocations[i]->block == NULL) {
+				continue;
+			}
+			uint32_t heap = memoryProperties->memoryTypes[allocations[i]->block->memoryTypeIndex].heapIndex;
+			heapSizes[heap] += allocations[i]->size;
+			if (heapSizes[heap] > memoryProperties->memoryHeaps[heap].size) {
+				culkan->result.ckResult = NOT_ENOUGH_MEMORY;
+				char message[128];
+				sprintf(message,
+					"Heap %u is not big enough: bindings up to %u request %llu bytes, available %llu",
+					heap,
+					binding,
+					(unsigned long long)heapSizes[heap],
+					(unsigned long long)memoryProperties->memoryHeaps[heap].size);
+				culkanCheckErrorWithMessage(culkan, message);
+				return;
+			}
 		}
 	}
 }
 
 void culkanCheckInvocations(Culkan* culkan) {
-	if (culkan->deviceProperties.limits.maxComputeWorkGroupInvocations <
+	if (culkan->context->deviceProperties.limits.maxComputeWorkGroupInvocations <
 	    culkan->invocations.x * culkan->invocations.y * culkan->invocations.z) {
 		culkan->result.ckResult = TOO_MANY_INVOCATIONS;
 		char message[70];
 		sprintf(message,
 			"Max invocations: %d, requested invocations: %d",
-			culkan->deviceProperties.limits.maxComputeWorkGroupInvocations,
+			culkan->context->deviceProperties.limits.maxComputeWorkGroupInvocations,
 			culkan->invocations.x * culkan->invocations.y * culkan->invocations.z);
 		culkanCheckErrorWithMessage(culkan, message);
 	}
 }
 
-Culkan* culkanInit(const CulkanLayout* layout, const char* shaderPath, CulkanInvocations invocations) {
-	Culkan* culkan	    = culkanMalloc(Culkan, 1);
-	culkan->layout	    = layout;
-	culkan->shaderPath  = shaderPath;
-	culkan->invocations = invocations;
+const char* culkanGetPipelineCachePath(Culkan* culkan) {
+	return culkan->context->pipelineCachePath;
+}
+
+// Path of the pipeline cache file of the device, see culkanGetPipelineCachePath()
+char* culkanMakePipelineCachePath(CulkanContext* context) {
+	const char* enabled = getenv("CULKAN_PIPELINE_CACHE");
+	if (enabled != NULL && strcmp(enabled, "0") == 0) {
+		return NULL;
+	}
+
+	char dir[4096];
+	const char* cacheDir = getenv("CULKAN_PIPELINE_CACHE_DIR");
+	const char* xdgCache = getenv("XDG_CACHE_HOME");
+	const char* home     = getenv("HOME");
+	if (cacheDir != NULL && cacheDir[0] != '\0') {
+		snprintf(dir, sizeof(dir), "%s", cacheDir);
+	}
+	else if (xdgCache != NULL && xdgCache[0] != '\0') {
+		snprintf(dir, sizeof(dir), "%s/culkan", xdgCache);
+	}
+	else if (home != NULL && home[0] != '\0') {
+		snprintf(dir, sizeof(dir), "%s/.cache/culkan", home);
+	}
+	else {
+		return NULL;
+	}
+
+	char uuid[2 * VK_UUID_SIZE + 1];
+	for (uint32_t i = 0; i < VK_UUID_SIZE; i++) {
+		snprintf(uuid + 2 * i, 3, "%02x", context->deviceProperties.pipelineCacheUUID[i]);
+	}
+
+	const VkPhysicalDeviceProperties* properties = &context->deviceProperties;
+	size_t size				     = strlen(dir) + 128;
+	char* path				     = culkanMalloc(char, size);
+	snprintf(path,
+		 size,
+		 "%s/pipeline-%04x-%04x-%08x-%s.bin",
+		 dir,
+		 properties->vendorID,
+		 properties->deviceID,
+		 properties->driverVersion,
+		 uuid);
+	return path;
+}
+
+/**
+ * @brief Reads the pipeline cache file of the device
+ * @return the data, to be freed, or NULL if there is no file or it was written for another device or driver
+ */
+void* culkanReadPipelineCache(CulkanContext* context, size_t* size) {
+	*size = 0;
+	if (context->pipelineCachePath == NULL) {
+		return NULL;
+	}
+	FILE* file = fopen(context->pipelineCachePath, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	// Header of VK_PIPELINE_CACHE_HEADER_VERSION_ONE: size, version, vendor, device, then the UUID
+	const size_t headerSize = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+	uint8_t* data		= length >= (long)headerSize ? culkanMalloc(uint8_t, (size_t)length) : NULL;
+	if (data == NULL || fread(data, 1, (size_t)length, file) != (size_t)length) {
+		free(data);
+		fclose(file);
+		return NULL;
+	}
+	fclose(file);
+
+	uint32_t header[4];
+	memcpy(header, data, sizeof(header));
+	if (header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || header[2] != context->deviceProperties.vendorID ||
+	    header[3] != context->deviceProperties.deviceID ||
+	    memcmp(data + sizeof(header), context->deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+		free(data);
+		return NULL;
+	}
+	*size = (size_t)length;
+	return data;
+}
+
+// Creates every missing directory of a path, like mkdir -p
+void culkanMakeDirectories(const char* path) {
+	char* copy = strdup(path);
+	for (char* slash = strchr(copy + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+		*slash = '\0';
+		mkdir(copy, 0755);
+		*slash = '/';
+	}
+	mkdir(copy, 0755);
+	free(copy);
+}
 
-	culkan->appInfo = (VkApplicationInfo){
+/**
+ * @brief Writes the pipeline cache of the instance to its file.
+ * It is written to a temporary file renamed over the previous one, so that concurrent processes never read a partial cache.
+ * Failures are not errors, the next process compiles the shader again.
+ */
+void culkanWritePipelineCache(CulkanContext* context) {
+	if (context->pipelineCachePath == NULL || context->pipelineCache == VK_NULL_HANDLE) {
+		return;
+	}
+	size_t size = 0;
+	if (vkGetPipelineCacheData(context->device, context->pipelineCache, &size, NULL) != VK_SUCCESS || size == 0) {
+		return;
+	}
+	void* data = malloc(size);
+	if (data == NULL || vkGetPipelineCacheData(context->device, context->pipelineCache, &size, data) != VK_SUCCESS) {
+		free(data);
+		return;
+	}
+
+	char* dir	= strdup(context->pipelineCachePath);
+	char* lastSlash = strrchr(dir, '/');
+	if (lastSlash != NULL) {
+		*lastSlash = '\0';
+		culkanMakeDirectories(dir);
+	}
+	free(dir);
+
+	size_t tmpSize = strlen(context->pipelineCachePath) + 32;
+	char* tmpPath  = culkanMalloc(char, tmpSize);
+	snprintf(tmpPath, tmpSize, "%s.%ld.tmp", context->pipelineCachePath, (long)getpid());
+	FILE* file = fopen(tmpPath, "wb");
+	if (file != NULL) {
+		int written = fwrite(data, 1, size, file) == size;
+		if (fclose(file) == 0 && written) {
+			rename(tmpPath, context->pipelineCachePath);
+		}
+		else {
+			remove(tmpPath);
+		}
+	}
+	free(tmpPath);
+	free(data);
+}
+
+CulkanContext* culkanCreateContext(void) {
+	CulkanContext* context = culkanMalloc(CulkanContext, 1);
+	context->result	       = (CulkanResult){VK_SUCCESS, NO_ERROR};
+
+	context->appInfo = (VkApplicationInfo){
 	    .sType		= VK_STRUCTURE_TYPE_APPLICATION_INFO,
 	    .pNext		= NULL,
 	    .pApplicationName	= "CulkanApp",
@@ -590,69 +1815,278 @@ Culkan* culkanInit(const CulkanLayout* layout, const char* shaderPath, CulkanInv
 	    .apiVersion		= VK_API_VERSION_1_3,
 	};
 
-	culkan->createInfo = (VkInstanceCreateInfo){
+	context->createInfo = (VkInstanceCreateInfo){
 	    .sType		     = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 	    .pNext		     = NULL,
 	    .flags		     = 0,
-	    .pApplicationInfo	     = &culkan->appInfo,
+	    .pApplicationInfo	     = &context->appInfo,
 	    .enabledLayerCount	     = 0,
 	    .ppEnabledLayerNames     = NULL,
 	    .enabledExtensionCount   = 0,
 	    .ppEnabledExtensionNames = NULL,
 	};
 
-	culkan->result.vkResult = vkCreateInstance(&culkan->createInfo, NULL, &culkan->instance);
-	culkanCheckError(culkan);
-
-	culkanGetPhysicalDevices(culkan);
+	context->result.vkResult = vkCreateInstance(&context->createInfo, NULL, &context->instance);
+	culkanCheckError(context);
 
-	vkGetPhysicalDeviceProperties(culkan->physicalDevice, &culkan->deviceProperties);
+	culkanGetPhysicalDevices(context);
 
-	culkan->family = 0;
+	vkGetPhysicalDeviceProperties(context->physicalDevice, &context->deviceProperties);
+	context->pipelineCachePath = culkanMakePipelineCachePath(context);
 
-	culkanCheckInvocations(culkan);
-
-	vkGetPhysicalDeviceQueueFamilyProperties(culkan->physicalDevice, &culkan->queueFamilyCount, NULL);
-	culkan->queueFamilies = culkanMalloc(VkQueueFamilyProperties, culkan->queueFamilyCount);
-	vkGetPhysicalDeviceQueueFamilyProperties(culkan->physicalDevice, &culkan->queueFamilyCount, culkan->queueFamilies);
+	vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &context->queueFamilyCount, NULL);
+	context->queueFamilies = culkanMalloc(VkQueueFamilyProperties, context->queueFamilyCount);
+	vkGetPhysicalDeviceQueueFamilyProperties(context->physicalDevice, &context->queueFamilyCount, context->queueFamilies);
 
 	uint32_t family = 0;
-	while (family < culkan->queueFamilyCount && !(culkan->queueFamilies[family].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+	while (family < context->queueFamilyCount && !(context->queueFamilies[family].queueFlags & VK_QUEUE_COMPUTE_BIT)) {
 		family++;
 	}
 
-	if (family == culkan->queueFamilyCount) {
+	if (family == context->queueFamilyCount) {
 		printf("No compute queue family found\n");
 		exit(1);
 	}
+	context->family = family;
+
+	uint32_t validBits     = context->queueFamilies[family].timestampValidBits;
+	context->timestampMask = validBits >= 64 ? UINT64_MAX : (UINT64_C(1) << validBits) - 1;
 
-	culkan->queuePriorities = (float*)(float[]){1.0F}; // Obliged to do double cast because C++ won't allow it otherwise (I hate C++)
+	context->queuePriorities = (float*)(float[]){1.0F}; // Obliged to do double cast because C++ won't allow it otherwise (I hate C++)
 	const VkDeviceQueueCreateInfo queueCreateInfo = {
 	    .sType	      = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
 	    .pNext	      = NULL,
 	    .flags	      = 0,
 	    .queueFamilyIndex = family,
 	    .queueCount	      = 1,
-	    .pQueuePriorities = culkan->queuePriorities,
+	    .pQueuePriorities = context->queuePriorities,
 	};
 
-	culkan->deviceCreateInfo = (VkDeviceCreateInfo){
+	// Timeline semaphores, for the sequences, and the control of the subgroup size of the compute pipelines, core since
+	// Vulkan 1.3, are enabled if the device supports them
+	VkPhysicalDeviceVulkan13Features supported13Features = {};
+	supported13Features.sType			     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	VkPhysicalDeviceVulkan12Features supportedFeatures   = {};
+	supportedFeatures.sType				     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	supportedFeatures.pNext				     = NULL;
+	if (context->deviceProperties.apiVersion >= VK_API_VERSION_1_3) {
+		supportedFeatures.pNext = &supported13Features;
+	}
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType			   = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext			   = &supportedFeatures;
+	if (context->deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+		vkGetPhysicalDeviceFeatures2(context->physicalDevice, &features);
+	}
+	VkBool32 hasTimeline	= supportedFeatures.timelineSemaphore;
+	VkBool32 hasSizeControl = supported13Features.subgroupSizeControl && supported13Features.computeFullSubgroups;
+
+	VkPhysicalDeviceVulkan13Features vulkan13Features = {};
+	vulkan13Features.sType				  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+	vulkan13Features.subgroupSizeControl		  = hasSizeControl;
+	vulkan13Features.computeFullSubgroups		  = hasSizeControl;
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType				  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_12_FEATURES;
+	vulkan12Features.pNext				  = hasSizeControl ? &vulkan13Features : NULL;
+	vulkan12Features.timelineSemaphore		  = hasTimeline;
+	// A device with the Vulkan 1.3 features also has the Vulkan 1.2 ones, which head the chain
+	void* enabledChain = hasTimeline || hasSizeControl ? &vulkan12Features : NULL;
+
+	// Host allocations are imported if the device supports it (it needs VK_KHR_external_memory, core since Vulkan 1.1)
+	const char* hostImport = getenv("CULKAN_HOST_IMPORT");
+	int hasHostImport      = 0;
+	if ((hostImport == NULL || strcmp(hostImport, "0") != 0) && context->deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+		hasHostImport = culkanHasDeviceExtension(context, VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME);
+	}
+	const char* extensions[] = {VK_EXT_EXTERNAL_MEMORY_HOST_EXTENSION_NAME};
+
+	// Doubles, for the shaders that use them, are enabled if the device supports them
+	VkPhysicalDeviceFeatures supportedCoreFeatures = {};
+	vkGetPhysicalDeviceFeatures(context->physicalDevice, &supportedCoreFeatures);
+	VkPhysicalDeviceFeatures enabledFeatures = {};
+	enabledFeatures.shaderFloat64		 = supportedCoreFeatures.shaderFloat64;
+
+	context->deviceCreateInfo = (VkDeviceCreateInfo){
 	    .sType		     = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-	    .pNext		     = NULL,
+	    .pNext		     = enabledChain,
 	    .flags		     = 0,
 	    .queueCreateInfoCount    = 1,
 	    .pQueueCreateInfos	     = &queueCreateInfo,
 	    .enabledLayerCount	     = 0,
 	    .ppEnabledLayerNames     = NULL,
-	    .enabledExtensionCount   = 0,
-	    .ppEnabledExtensionNames = NULL,
-	    .pEnabledFeatures	     = NULL,
+	    .enabledExtensionCount   = hasHostImport ? 1U : 0U,
+	    .ppEnabledExtensionNames = hasHostImport ? extensions : NULL,
+	    .pEnabledFeatures	     = &enabledFeatures,
 	};
 
-	culkan->result.vkResult = vkCreateDevice(culkan->physicalDevice, &culkan->deviceCreateInfo, NULL, &culkan->device);
-	culkanCheckError(culkan);
+	context->result.vkResult = vkCreateDevice(context->physicalDevice, &context->deviceCreateInfo, NULL, &context->device);
+	culkanCheckError(context);
+
+	vkGetPhysicalDeviceMemoryProperties(context->physicalDevice, &context->memoryProperties);
+
+	vkGetDeviceQueue(context->device, context->family, 0, &context->queue);
+
+	context->getMemoryHostPointerProperties = NULL;
+	context->hostImportAlignment		= 0;
+	context->memoryBlocks			= NULL;
+	if (hasHostImport) {
+		VkPhysicalDeviceExternalMemoryHostPropertiesEXT hostProperties = {
+		    .sType			     = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+		    .pNext			     = NULL,
+		    .minImportedHostPointerAlignment = 0,
+		};
+		VkPhysicalDeviceProperties2 properties = {
+		    .sType	= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		    .pNext	= &hostProperties,
+		    .properties = {},
+		};
+		vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties);
+		context->hostImportAlignment		= hostProperties.minImportedHostPointerAlignment;
+		context->getMemoryHostPointerProperties =
+		    (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(context->device, "vkGetMemoryHostPointerPropertiesEXT");
+	}
+
+	context->features.shaderFloat64	   = enabledFeatures.shaderFloat64 == VK_TRUE;
+	context->features.subgroupSize	   = 1;
+	context->features.subgroupShuffle  = 0;
+	context->features.fullSubgroups	   = 0;
+	context->features.sharedMemorySize = context->deviceProperties.limits.maxComputeSharedMemorySize;
+	if (context->deviceProperties.apiVersion >= VK_API_VERSION_1_1) {
+		VkPhysicalDeviceSubgroupSizeControlProperties sizeControlProperties = {
+		    .sType			  = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES,
+		    .pNext			  = NULL,
+		    .minSubgroupSize		  = 0,
+		    .maxSubgroupSize		  = 0,
+		    .maxComputeWorkgroupSubgroups = 0,
+		    .requiredSubgroupSizeStages	  = 0,
+		};
+		VkPhysicalDeviceSubgroupProperties subgroupProperties = {
+		    .sType		       = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES,
+		    .pNext		       = hasSizeControl ? &sizeControlProperties : NULL,
+		    .subgroupSize	       = 1,
+		    .supportedStages	       = 0,
+		    .supportedOperations       = 0,
+		    .quadOperationsInAllStages = VK_FALSE,
+		};
+		VkPhysicalDeviceProperties2 properties = {
+		    .sType	= VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+		    .pNext	= &subgroupProperties,
+		    .properties = {},
+		};
+		vkGetPhysicalDeviceProperties2(context->physicalDevice, &properties);
+		context->features.subgroupSize	  = subgroupProperties.subgroupSize;
+		context->features.subgroupShuffle = (subgroupProperties.supportedStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+						    (subgroupProperties.supportedOperations & VK_SUBGROUP_FEATURE_SHUFFLE_BIT) != 0;
+		// The default size of the device, which is then required by the pipelines, must be one they can require
+		context->features.fullSubgroups = hasSizeControl &&
+						  (sizeControlProperties.requiredSubgroupSizeStages & VK_SHADER_STAGE_COMPUTE_BIT) != 0 &&
+						  sizeControlProperties.minSubgroupSize <= subgroupProperties.subgroupSize &&
+						  subgroupProperties.subgroupSize <= sizeControlProperties.maxSubgroupSize;
+	}
+
+	context->timeline      = VK_NULL_HANDLE;
+	context->timelineValue = 0;
+	if (hasTimeline) {
+		VkSemaphoreTypeCreateInfo typeInfo = {
+		    .sType	   = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		    .pNext	   = NULL,
+		    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		    .initialValue  = 0,
+		};
+		VkSemaphoreCreateInfo semaphoreInfo = {
+		    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		    .pNext = &typeInfo,
+		    .flags = 0,
+		};
+		context->result.vkResult = vkCreateSemaphore(context->device, &semaphoreInfo, NULL, &context->timeline);
+		culkanCheckError(context);
+	}
+
+	// Created before the bindings, whose staging copies need a command buffer.
+	// Its command buffers are reset one by one, the transfer one before each recording.
+	context->commandPoolCreateInfo = (VkCommandPoolCreateInfo){
+	    .sType	      = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+	    .pNext	      = NULL,
+	    .flags	      = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	    .queueFamilyIndex = context->family,
+	};
+
+	context->result.vkResult = vkCreateCommandPool(context->device, &context->commandPoolCreateInfo, NULL, &context->commandPool);
+	culkanCheckError(context);
+
+	context->transferCommandBuffer = culkanAllocateCommandBuffer(context);
+	context->transferFence	       = culkanCreateFence(context);
+	context->transferPending       = 0;
+	context->pendingUploads	       = NULL;
+	context->pendingUploadCount    = 0;
+	context->pendingUploadCapacity = 0;
+
+	// The driver skips the compilation of the shaders if a previous process left them in the pipeline cache file
+	size_t cacheSize		    = 0;
+	void* cacheData			    = culkanReadPipelineCache(context, &cacheSize);
+	VkPipelineCacheCreateInfo cacheInfo = {
+	    .sType	     = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+	    .pNext	     = NULL,
+	    .flags	     = 0,
+	    .initialDataSize = cacheSize,
+	    .pInitialData    = cacheData,
+	};
+	context->result.vkResult = vkCreatePipelineCache(context->device, &cacheInfo, NULL, &context->pipelineCache);
+	if (context->result.vkResult != VK_SUCCESS && cacheData != NULL) {
+		// A cache the driver rejects is ignored, as if there were no file
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData	  = NULL;
+		context->result.vkResult  = vkCreatePipelineCache(context->device, &cacheInfo, NULL, &context->pipelineCache);
+	}
+	culkanCheckError(context);
+	free(cacheData);
+
+	return context;
+}
+
+void culkanDestroyContext(CulkanContext* context) {
+	culkanWaitTransfer(context);
+	free(context->pendingUploads);
+	culkanWritePipelineCache(context);
+	vkDestroyPipelineCache(context->device, context->pipelineCache, NULL);
+	free(context->pipelineCachePath);
+	vkDestroyFence(context->device, context->transferFence, NULL);
+	if (context->timeline != VK_NULL_HANDLE) {
+		vkDestroySemaphore(context->device, context->timeline, NULL);
+	}
+	vkDestroyCommandPool(context->device, context->commandPool, NULL);
+	while (context->memoryBlocks != NULL) {
+		culkanDestroyMemoryBlock(context, context->memoryBlocks);
+	}
+	vkDestroyDevice(context->device, NULL);
+	vkDestroyInstance(context->instance, NULL);
+	free(context->physicalDevices);
+	free(context->queueFamilies);
+	free(context);
+}
 
-	vkGetPhysicalDeviceMemoryProperties(culkan->physicalDevice, &culkan->memoryProperties);
+// Creates the buffers of an instance on a context, or on a context of its own if context is NULL.
+// The shader is only read by culkanSetup().
+Culkan* culkanCreate(CulkanContext* context, const CulkanLayout* layout, CulkanInvocations invocations) {
+	Culkan* culkan		   = culkanMalloc(Culkan, 1);
+	culkan->ownsContext	   = context == NULL;
+	culkan->context		   = context != NULL ? context : culkanCreateContext();
+	culkan->result		   = (CulkanResult){VK_SUCCESS, NO_ERROR};
+	culkan->layout		   = layout;
+	culkan->shaderPath	   = NULL;
+	culkan->shaderCode	   = NULL;
+	culkan->shaderCodeSize	   = 0;
+	culkan->invocations	   = invocations;
+	culkan->groupCount	   = (CulkanGroupCount){1, 1, 1};
+	culkan->commandBuffer	   = VK_NULL_HANDLE;
+	culkan->commandBufferDirty = 0;
+	culkan->pushConstantData   = layout->pushConstantSize != 0 ? calloc(1, layout->pushConstantSize) : NULL;
+
+	culkanCheckInvocations(culkan);
+
+	// Created once and reset after each run, so that running in a loop creates nothing
+	culkan->computeFence   = culkanCreateFence(culkan->context);
+	culkan->computePending = 0;
 
 	culkanGPUAlloc(culkan);
 
@@ -666,7 +2100,89 @@ Culkan* culkanInit(const CulkanLayout* layout, const char* shaderPath, CulkanInv
 	return culkan;
 }
 
+Culkan* culkanInit(const CulkanLayout* layout, const char* shaderPath, CulkanInvocations invocations) {
+	Culkan* culkan	   = culkanCreate(NULL, layout, invocations);
+	culkan->shaderPath = shaderPath;
+	return culkan;
+}
+
+Culkan* culkanInitFromMemory(const CulkanLayout* layout, const uint32_t* spirv, size_t spirvSize, CulkanInvocations invocations) {
+	return culkanInitWithContext(NULL, layout, spirv, spirvSize, invocations);
+}
+
+Culkan* culkanInitWithContext(CulkanContext* context, const CulkanLayout* layout, const uint32_t* spirv, size_t spirvSize,
+			      CulkanInvocations invocations) {
+	Culkan* culkan	       = culkanCreate(context, layout, invocations);
+	culkan->shaderCode     = spirv;
+	culkan->shaderCodeSize = spirvSize;
+	return culkan;
+}
+
+CulkanContext* culkanGetContext(Culkan* culkan) {
+	return culkan->context;
+}
+
+CulkanDeviceFeatures culkanGetDeviceFeatures(CulkanContext* context) {
+	return context->features;
+}
+
+// Submission of the last run of an instance, complete if there is none
+CulkanSubmission culkanGetSubmission(Culkan* culkan) {
+	return (CulkanSubmission){
+	    .context = culkan->context,
+	    .fence   = culkan->computeFence,
+	    .value   = 0,
+	    .pending = &culkan->computePending,
+	};
+}
+
+CulkanSubmission culkanGetSequenceSubmission(CulkanSequence* sequence) {
+	return (CulkanSubmission){
+	    .context = sequence->context,
+	    .fence   = sequence->fence,
+	    .value   = sequence->value,
+	    .pending = &sequence->pending,
+	};
+}
+
+// Records the dispatch of the shader over the grid of the instance, the command buffer is submitted as is by every run
+void culkanRecordCommandBuffer(Culkan* culkan) {
+	culkan->result.vkResult = vkResetCommandBuffer(culkan->commandBuffer, 0);
+	culkanCheckError(culkan);
+	culkan->result.vkResult = vkBeginCommandBuffer(culkan->commandBuffer, &culkan->commandBufferBeginInfo);
+	culkanCheckError(culkan);
+	vkCmdBindPipeline(culkan->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culkan->pipeline);
+	vkCmdBindDescriptorSets(
+	    culkan->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culkan->pipelineLayout, 0, 1, &culkan->descriptorSet, 0, NULL);
+	if (culkan->layout->pushConstantSize != 0) {
+		vkCmdPushConstants(culkan->commandBuffer,
+				   culkan->pipelineLayout,
+				   VK_SHADER_STAGE_COMPUTE_BIT,
+				   0,
+				   culkan->layout->pushConstantSize,
+				   culkan->pushConstantData);
+	}
+	vkCmdDispatch(culkan->commandBuffer, culkan->groupCount.x, culkan->groupCount.y, culkan->groupCount.z);
+	culkan->result.vkResult = vkEndCommandBuffer(culkan->commandBuffer);
+	culkanCheckError(culkan);
+	culkan->commandBufferDirty = 0;
+}
+
+void culkanSetPushConstants(Culkan* culkan, const void* data) {
+	memcpy(culkan->pushConstantData, data, culkan->layout->pushConstantSize);
+	// Recorded by the next submission rather than now, so that setting them several times between runs records once
+	culkan->commandBufferDirty = culkan->commandBuffer != VK_NULL_HANDLE;
+}
+
 void culkanSetup(Culkan* culkan) {
+	VkDevice device = culkan->context->device;
+
+	uint32_t requiredSubgroupSize = culkan->layout->requiredSubgroupSize;
+	if (requiredSubgroupSize != 0 &&
+	    (!culkan->context->features.fullSubgroups || requiredSubgroupSize != culkan->context->features.subgroupSize)) {
+		culkan->result.ckResult = UNSUPPORTED_FEATURE;
+		culkanCheckError(culkan);
+	}
 
 	VkDescriptorSetLayoutBinding* layoutBindings = culkanMalloc(VkDescriptorSetLayoutBinding, culkan->layout->bindingCount);
 
@@ -689,7 +2205,7 @@ void culkanSetup(Culkan* culkan) {
 	};
 
 	culkan->result.vkResult =
-	    vkCreateDescriptorSetLayout(culkan->device, &culkan->descriptorSetLayoutCreateInfo, NULL, &culkan->descriptorSetLayout);
+	    vkCreateDescriptorSetLayout(device, &culkan->descriptorSetLayoutCreateInfo, NULL, &culkan->descriptorSetLayout);
 	culkanCheckError(culkan);
 
 	culkan->poolSizeInfo = createDescriptorPoolSize(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1);
@@ -711,7 +2227,7 @@ void culkanSetup(Culkan* culkan) {
 	    .pPoolSizes	   = culkan->pPoolSizes,
 	};
 
-	culkan->result.vkResult = vkCreateDescriptorPool(culkan->device, &culkan->descriptorPoolCreateInfo, NULL, &culkan->descriptorPool);
+	culkan->result.vkResult = vkCreateDescriptorPool(device, &culkan->descriptorPoolCreateInfo, NULL, &culkan->descriptorPool);
 	culkanCheckError(culkan);
 
 	culkan->descriptorSetAllocateInfo = (VkDescriptorSetAllocateInfo){
@@ -722,28 +2238,46 @@ void culkanSetup(Culkan* culkan) {
 	    .pSetLayouts	= &culkan->descriptorSetLayout,
 	};
 
-	culkan->result.vkResult = vkAllocateDescriptorSets(culkan->device, &culkan->descriptorSetAllocateInfo, &culkan->descriptorSet);
+	culkan->result.vkResult = vkAllocateDescriptorSets(device, &culkan->descriptorSetAllocateInfo, &culkan->descriptorSet);
 	culkanCheckError(culkan);
 
 	for (uint32_t i = 0; i < culkan->layout->bindingCount; i++) {
 		culkan->descriptorWritesVar[i] = createDescriptorSetWrite(culkan->descriptorSet, culkan->variables[i].bufferInfoVar, i);
-		vkUpdateDescriptorSets(culkan->device, 1, culkan->descriptorWritesVar[i], 0, NULL);
+		vkUpdateDescriptorSets(device, 1, culkan->descriptorWritesVar[i], 0, NULL);
 	}
 
+	if (culkan->layout->pushConstantSize > culkan->context->deviceProperties.limits.maxPushConstantsSize) {
+		culkan->result.ckResult = NOT_ENOUGH_MEMORY;
+		culkanCheckErrorWithMessage(culkan, "Push constant block larger than maxPushConstantsSize");
+	}
+	VkPushConstantRange pushConstantRange = {
+	    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+	    .offset	= 0,
+	    .size	= culkan->layout->pushConstantSize,
+	};
+
 	culkan->pipelineLayoutCreateInfo = (VkPipelineLayoutCreateInfo){
 	    .sType		    = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 	    .pNext		    = NULL,
 	    .flags		    = 0,
 	    .setLayoutCount	    = 1,
 	    .pSetLayouts	    = &culkan->descriptorSetLayout,
-	    .pushConstantRangeCount = 0,
-	    .pPushConstantRanges    = NULL,
+	    .pushConstantRangeCount = pushConstantRange.size != 0 ? 1U : 0U,
+	    .pPushConstantRanges    = pushConstantRange.size != 0 ? &pushConstantRange : NULL,
 	};
 
-	culkan->result.vkResult = vkCreatePipelineLayout(culkan->device, &culkan->pipelineLayoutCreateInfo, NULL, &culkan->pipelineLayout);
+	culkan->result.vkResult = vkCreatePipelineLayout(device, &culkan->pipelineLayoutCreateInfo, NULL, &culkan->pipelineLayout);
 	culkanCheckError(culkan);
 
-	culkan->shaderBuffer = culkanOpenShader(culkan->shaderPath, &culkan->fileSize, culkan);
+	if (culkan->shaderCode != NULL) {
+		// Copied so that the buffer is owned by the instance, whichever way the shader was given
+		culkan->fileSize     = culkan->shaderCodeSize;
+		culkan->shaderBuffer = culkanMalloc(uint32_t, (culkan->fileSize + sizeof(uint32_t) - 1) / sizeof(uint32_t));
+		memcpy(culkan->shaderBuffer, culkan->shaderCode, culkan->fileSize);
+	}
+	else {
+		culkan->shaderBuffer = culkanOpenShader(culkan->shaderPath, &culkan->fileSize, culkan);
+	}
 
 	culkan->shaderModuleCreateInfo = (VkShaderModuleCreateInfo){
 	    .sType    = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
@@ -753,17 +2287,42 @@ void culkanSetup(Culkan* culkan) {
 	    .pCode    = culkan->shaderBuffer,
 	};
 
-	culkan->result.vkResult = vkCreateShaderModule(culkan->device, &culkan->shaderModuleCreateInfo, NULL, &culkan->shaderModule);
+	culkan->result.vkResult = vkCreateShaderModule(device, &culkan->shaderModuleCreateInfo, NULL, &culkan->shaderModule);
 	culkanCheckError(culkan);
 
+	// Specialization constants are folded into the pipeline, so that the driver can unroll the loops they bound
+	uint32_t specializationCount = culkan->layout->specializationConstants != NULL ? culkan->layout->specializationConstantCount : 0;
+
+	VkSpecializationMapEntry* specializationEntries = culkanMalloc(VkSpecializationMapEntry, specializationCount + 1);
+	for (uint32_t i = 0; i < specializationCount; i++) {
+		specializationEntries[i] = (VkSpecializationMapEntry){
+		    .constantID = i,
+		    .offset	= i * (uint32_t)sizeof(uint32_t),
+		    .size	= sizeof(uint32_t),
+		};
+	}
+	VkSpecializationInfo specializationInfo = {
+	    .mapEntryCount = specializationCount,
+	    .pMapEntries   = specializationEntries,
+	    .dataSize	   = specializationCount * sizeof(uint32_t),
+	    .pData	   = culkan->layout->specializationConstants,
+	};
+
+	// So that the shader can rely on gl_SubgroupSize being the specialized one and on every lane of its subgroups being active
+	VkPipelineShaderStageRequiredSubgroupSizeCreateInfo requiredSizeInfo = {
+	    .sType		  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO,
+	    .pNext		  = NULL,
+	    .requiredSubgroupSize = requiredSubgroupSize,
+	};
+
 	culkan->stageCreateInfo = (VkPipelineShaderStageCreateInfo){
 	    .sType		 = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-	    .pNext		 = NULL,
-	    .flags		 = 0,
+	    .pNext		 = requiredSubgroupSize != 0 ? &requiredSizeInfo : NULL,
+	    .flags		 = requiredSubgroupSize != 0 ? VK_PIPELINE_SHADER_STAGE_CREATE_REQUIRE_FULL_SUBGROUPS_BIT : 0U,
 	    .stage		 = VK_SHADER_STAGE_COMPUTE_BIT,
 	    .module		 = culkan->shaderModule,
 	    .pName		 = "main",
-	    .pSpecializationInfo = NULL,
+	    .pSpecializationInfo = specializationCount != 0 ? &specializationInfo : NULL,
 	};
 
 	culkan->pipelineCreateInfo = (VkComputePipelineCreateInfo){
@@ -777,95 +2336,562 @@ void culkanSetup(Culkan* culkan) {
 	};
 
 	culkan->result.vkResult =
-	    vkCreateComputePipelines(culkan->device, VK_NULL_HANDLE, 1, &culkan->pipelineCreateInfo, NULL, &culkan->pipeline);
+	    vkCreateComputePipelines(device, culkan->context->pipelineCache, 1, &culkan->pipelineCreateInfo, NULL, &culkan->pipeline);
 	culkanCheckError(culkan);
+	free(specializationEntries);
+	culkan->stageCreateInfo.pSpecializationInfo = NULL;
+	culkan->stageCreateInfo.pNext		    = NULL;
 
-	culkan->commandPoolCreateInfo = (VkCommandPoolCreateInfo){
-	    .sType	      = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+	culkan->commandBuffer = culkanAllocateCommandBuffer(culkan->context);
+
+	culkan->commandBufferBeginInfo = (VkCommandBufferBeginInfo){
+	    .sType	      = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 	    .pNext	      = NULL,
 	    .flags	      = 0,
-	    .queueFamilyIndex = culkan->family,
+	    .pInheritanceInfo = NULL,
 	};
 
-	culkan->result.vkResult = vkCreateCommandPool(culkan->device, &culkan->commandPoolCreateInfo, NULL, &culkan->commandPool);
-	culkanCheckError(culkan);
+	culkanRecordCommandBuffer(culkan);
+}
 
-	culkan->commandBufferAllocateInfo = (VkCommandBufferAllocateInfo){
-	    .sType		= VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-	    .pNext		= NULL,
-	    .commandPool	= culkan->commandPool,
-	    .level		= VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-	    .commandBufferCount = 1,
+void culkanSetGroupCount(Culkan* culkan, CulkanGroupCount groupCount) {
+	const uint32_t* maxCount = culkan->context->deviceProperties.limits.maxComputeWorkGroupCount;
+	if (groupCount.x == 0 || groupCount.y == 0 || groupCount.z == 0 || groupCount.x > maxCount[0] || groupCount.y > maxCount[1] ||
+	    groupCount.z > maxCount[2]) {
+		culkan->result.ckResult = TOO_MANY_INVOCATIONS;
+		char message[128];
+		sprintf(message,
+			"Max workgroups: (%u, %u, %u), requested workgroups: (%u, %u, %u)",
+			maxCount[0],
+			maxCount[1],
+			maxCount[2],
+			groupCount.x,
+			groupCount.y,
+			groupCount.z);
+		culkanCheckErrorWithMessage(culkan, message);
+	}
+	culkan->groupCount = groupCount;
+
+	if (culkan->commandBuffer != VK_NULL_HANDLE) {
+		// The command buffer cannot be recorded while a run is using it
+		culkanWait(culkanGetSubmission(culkan));
+		culkanRecordCommandBuffer(culkan);
+	}
+}
+
+CulkanSubmission culkanSubmit(Culkan* culkan) {
+	CulkanSubmission submission = culkanGetSubmission(culkan);
+	culkanWait(submission);
+	if (culkan->commandBufferDirty) {
+		culkanRecordCommandBuffer(culkan);
+	}
+
+	culkanSubmitUploads(culkan->context);
+	culkanSubmitCommandBuffer(culkan->context, culkan->commandBuffer, culkan->computeFence);
+	culkan->computePending = 1;
+	return submission;
+}
+
+int culkanIsComplete(CulkanSubmission submission) {
+	CulkanContext* context = submission.context;
+	if (!*submission.pending) {
+		return 1;
+	}
+	if (submission.fence == VK_NULL_HANDLE) {
+		uint64_t value		 = 0;
+		context->result.vkResult = vkGetSemaphoreCounterValue(context->device, context->timeline, &value);
+		culkanCheckError(context);
+		return value >= submission.value;
+	}
+	context->result.vkResult = vkGetFenceStatus(context->device, submission.fence);
+	if (context->result.vkResult == VK_NOT_READY) {
+		context->result.vkResult = VK_SUCCESS;
+		return 0;
+	}
+	culkanCheckError(context);
+	return 1;
+}
+
+void culkanWait(CulkanSubmission submission) {
+	CulkanContext* context = submission.context;
+	if (!*submission.pending) {
+		return;
+	}
+	if (submission.fence == VK_NULL_HANDLE) {
+		// Nothing to reset, the next submission signals a greater value
+		VkSemaphoreWaitInfo waitInfo = {
+		    .sType	    = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		    .pNext	    = NULL,
+		    .flags	    = 0,
+		    .semaphoreCount = 1,
+		    .pSemaphores    = &context->timeline,
+		    .pValues	    = &submission.value,
+		};
+		context->result.vkResult = vkWaitSemaphores(context->device, &waitInfo, UINT64_MAX);
+		culkanCheckError(context);
+		*submission.pending = 0;
+		return;
+	}
+	context->result.vkResult = vkWaitForFences(context->device, 1, &submission.fence, VK_TRUE, UINT64_MAX);
+	culkanCheckError(context);
+	context->result.vkResult = vkResetFences(context->device, 1, &submission.fence);
+	culkanCheckError(context);
+	*submission.pending = 0;
+}
+
+void culkanRun(Culkan* culkan) {
+	culkanWait(culkanSubmit(culkan));
+}
+
+void culkanDestroy(Culkan* culkan) {
+	// The command buffer and the buffers may still be in use by a submission that was not waited for
+	culkanWait(culkanGetSubmission(culkan));
+
+	free(culkan->shaderBuffer);
+	vkDestroyShaderModule(culkan->context->device, culkan->shaderModule, NULL);
+	vkDestroyPipeline(culkan->context->device, culkan->pipeline, NULL);
+	vkDestroyPipelineLayout(culkan->context->device, culkan->pipelineLayout, NULL);
+	vkDestroyDescriptorPool(culkan->context->device, culkan->descriptorPool, NULL);
+	vkDestroyDescriptorSetLayout(culkan->context->device, culkan->descriptorSetLayout, NULL);
+	if (culkan->commandBuffer != VK_NULL_HANDLE) {
+		vkFreeCommandBuffers(culkan->context->device, culkan->context->commandPool, 1, &culkan->commandBuffer);
+	}
+
+	// The buffers and their memory belong to the device, so they are freed before it
+	for (uint32_t i = 0; i < culkan->layout->bindingCount; i++) {
+		freeGPUVariableData(&culkan->variables[i]);
+	}
+	free(culkan->variables);
+
+	vkDestroyFence(culkan->context->device, culkan->computeFence, NULL);
+	if (culkan->ownsContext) {
+		culkanDestroyContext(culkan->context);
+	}
+	free(culkan->pushConstantData);
+	free(culkan);
+}
+
+int culkanImportBinding(Culkan* culkan, uint32_t binding, void* hostPointer) {
+	CulkanContext* context = culkan->context;
+	VkDevice device	       = context->device;
+	GPUVariable* variable  = culkanGetBinding(culkan, binding);
+	VkDeviceSize alignment = context->hostImportAlignment;
+	if (variable->importedVar == hostPointer) {
+		return 1;
+	}
+	if (context->getMemoryHostPointerProperties == NULL || (uintptr_t)hostPointer % alignment != 0) {
+		return 0;
+	}
+
+	// Memory types that can hold the allocation, none if it is not memory the driver can import (a mapped file, ...)
+	VkExternalMemoryHandleTypeFlagBits handleType	   = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT;
+	VkMemoryHostPointerPropertiesEXT pointerProperties = {
+	    .sType	    = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+	    .pNext	    = NULL,
+	    .memoryTypeBits = 0,
 	};
+	if (context->getMemoryHostPointerProperties(device, handleType, hostPointer, &pointerProperties) != VK_SUCCESS) {
+		return 0;
+	}
 
-	culkan->result.vkResult = vkAllocateCommandBuffers(culkan->device, &culkan->commandBufferAllocateInfo, &culkan->commandBuffer);
+	VkExternalMemoryBufferCreateInfo externalInfo = {
+	    .sType	 = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+	    .pNext	 = NULL,
+	    .handleTypes = handleType,
+	};
+	VkBufferCreateInfo bufferInfo = *variable->bufferCreateInfoVar;
+	bufferInfo.pNext	      = &externalInfo;
+	VkBuffer buffer;
+	culkan->result.vkResult = vkCreateBuffer(device, &bufferInfo, NULL, &buffer);
 	culkanCheckError(culkan);
+	VkMemoryRequirements requirements;
+	vkGetBufferMemoryRequirements(device, buffer, &requirements);
+	// Coherent, the allocation is not mapped by Vulkan so it could not be flushed
+	uint32_t memoryTypeIndex = culkanFindMemoryType(&context->memoryProperties,
+							requirements.memoryTypeBits & pointerProperties.memoryTypeBits,
+							VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+							VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+							0);
+
+	VkImportMemoryHostPointerInfoEXT importInfo = {
+	    .sType	  = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+	    .pNext	  = NULL,
+	    .handleType	  = handleType,
+	    .pHostPointer = hostPointer,
+	};
+	VkMemoryAllocateInfo allocateInfo = {
+	    .sType	     = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+	    .pNext	     = &importInfo,
+	    .allocationSize  = (requirements.size + alignment - 1) / alignment * alignment,
+	    .memoryTypeIndex = memoryTypeIndex,
+	};
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkResult imported     = memoryTypeIndex != UINT32_MAX ? vkAllocateMemory(device, &allocateInfo, NULL, &memory) : VK_ERROR_UNKNOWN;
+	if (imported == VK_SUCCESS) {
+		imported = vkBindBufferMemory(device, buffer, memory, 0);
+	}
+	if (imported != VK_SUCCESS) {
+		// The binding keeps its memory, and the writes and reads copy
+		vkDestroyBuffer(device, buffer, NULL);
+		if (memory != VK_NULL_HANDLE) {
+			vkFreeMemory(device, memory, NULL);
+		}
+		return 0;
+	}
 
-	culkan->commandBufferBeginInfo = (VkCommandBufferBeginInfo){
+	// The previous buffer may be used by the last run
+	culkanWait(culkanGetSubmission(culkan));
+	freeGPUVariableMemory(variable);
+	*variable->vkBufferVar		 = buffer;
+	variable->deviceMemoryVar	 = memory;
+	variable->memoryPropertyFlagsVar = context->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+	variable->stagingBufferVar	 = VK_NULL_HANDLE;
+	variable->stagingMemoryVar	 = VK_NULL_HANDLE;
+	variable->allocationVar		 = (CulkanAllocation){.block = NULL, .offset = 0, .size = 0};
+	variable->stagingAllocationVar	 = variable->allocationVar;
+	variable->dataVar		 = hostPointer;
+	variable->importedVar		 = hostPointer;
+	variable->bufferInfoVar->buffer	 = buffer;
+
+	// After culkanSetup(), the descriptor set points to the previous buffer
+	if (culkan->commandBuffer != VK_NULL_HANDLE) {
+		vkUpdateDescriptorSets(device, 1, culkan->descriptorWritesVar[binding], 0, NULL);
+		culkan->commandBufferDirty = 1;
+	}
+	return 1;
+}
+
+size_t culkanGetHostImportAlignment(CulkanContext* context) {
+	return context->getMemoryHostPointerProperties != NULL ? (size_t)context->hostImportAlignment : 0;
+}
+
+size_t culkanGetMaxBindingSize(CulkanContext* context, CulkanBindingType type) {
+	const VkPhysicalDeviceLimits* limits = &context->deviceProperties.limits;
+	return type == UNIFORM_BUFFER ? limits->maxUniformBufferRange : limits->maxStorageBufferRange;
+}
+
+size_t culkanGetBindingHeapSize(CulkanContext* context, CulkanBindingType type) {
+	// Any memory type a buffer may allow
+	uint32_t memoryTypeIndex = culkanChooseMemoryType(context, type, UINT32_MAX);
+	if (memoryTypeIndex == UINT32_MAX) {
+		return 0;
+	}
+	return (size_t)context->memoryProperties.memoryHeaps[context->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+}
+
+void culkanResizeBinding(Culkan* culkan, uint32_t binding, size_t size) {
+	GPUVariable* variable = culkanGetBinding(culkan, binding);
+
+	// Refused before the previous buffer is freed, so that the binding keeps it
+	if (size > culkanGetMaxBindingSize(culkan->context, culkan->layout->bindings[binding].type)) {
+		culkan->result.ckResult = BINDING_TOO_LARGE;
+		culkanCheckErrorWithMessage(culkan, "Binding resized beyond the buffer range of the device");
+		return;
+	}
+
+	// The previous buffer may be used by the last run, its memory goes back to the pool for the new one
+	culkanWait(culkanGetSubmission(culkan));
+	freeGPUVariableData(variable);
+	GPUVariable* resized = createGPUVariable(culkan, size, culkan->layout->bindings[binding].type, binding);
+	*variable	     = *resized;
+	free(resized);
+
+	// After culkanSetup(), the descriptor set points to the previous buffer
+	if (culkan->commandBuffer != VK_NULL_HANDLE) {
+		free(culkan->descriptorWritesVar[binding]);
+		culkan->descriptorWritesVar[binding] = createDescriptorSetWrite(culkan->descriptorSet, variable->bufferInfoVar, binding);
+		vkUpdateDescriptorSets(culkan->context->device, 1, culkan->descriptorWritesVar[binding], 0, NULL);
+		culkan->commandBufferDirty = 1;
+	}
+}
+
+CulkanMemoryPoolStats culkanGetMemoryPoolStats(CulkanContext* context) {
+	CulkanMemoryPoolStats stats = {.blockCount = 0, .reservedBytes = 0, .usedBytes = 0};
+	for (CulkanMemoryBlock* block = context->memoryBlocks; block != NULL; block = block->next) {
+		stats.blockCount++;
+		stats.reservedBytes += block->size;
+		stats.usedBytes += block->size;
+		for (uint32_t i = 0; i < block->freeCount; i++) {
+			stats.usedBytes -= block->freeRanges[i].size;
+		}
+	}
+	return stats;
+}
+
+// Records a barrier between two kinds of accesses
+void culkanSequenceMemoryBarrier(CulkanSequence* sequence, VkPipelineStageFlags srcStages, VkAccessFlags srcAccess,
+				 VkPipelineStageFlags dstStages, VkAccessFlags dstAccess) {
+	culkanRecordMemoryBarrier(sequence->commandBuffer, srcStages, srcAccess, dstStages, dstAccess);
+}
+
+// Writes the timestamp before a command of a stage, returns whether the command is timed.
+// At the bottom of the pipe, written once the commands before it are done: the top of the pipe is outside the scope of the
+// barrier before the command, so the timestamp could be written before the barrier is passed and count its wait.
+int culkanSequenceBeginTimed(CulkanSequence* sequence, CulkanStage stage) {
+	if (sequence->queryPool == VK_NULL_HANDLE || sequence->timedCount == CULKAN_MAX_TIMED_COMMANDS) {
+		return 0;
+	}
+	sequence->timedStages[sequence->timedCount] = stage;
+	vkCmdWriteTimestamp(sequence->commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, sequence->queryPool, 2 * sequence->timedCount);
+	return 1;
+}
+
+// Writes the timestamp after a command timed by culkanSequenceBeginTimed()
+void culkanSequenceEndTimed(CulkanSequence* sequence, int timed) {
+	if (timed) {
+		vkCmdWriteTimestamp(
+		    sequence->commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, sequence->queryPool, 2 * sequence->timedCount + 1);
+		sequence->timedCount++;
+	}
+}
+
+CulkanSequence* culkanCreateSequence(CulkanContext* context) {
+	CulkanSequence* sequence = culkanMalloc(CulkanSequence, 1);
+	sequence->context	 = context;
+	sequence->commandBuffer	 = culkanAllocateCommandBuffer(context);
+	sequence->value		 = 0;
+	sequence->fence		 = context->timeline == VK_NULL_HANDLE ? culkanCreateFence(context) : VK_NULL_HANDLE;
+	sequence->pending	 = 0;
+	sequence->recording	 = 0;
+	sequence->queryPool	 = VK_NULL_HANDLE;
+	sequence->timedCount	 = 0;
+	if (context->timestampMask != 0) {
+		VkQueryPoolCreateInfo queryPoolInfo = {
+		    .sType		= VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		    .pNext		= NULL,
+		    .flags		= 0,
+		    .queryType		= VK_QUERY_TYPE_TIMESTAMP,
+		    .queryCount		= 2 * CULKAN_MAX_TIMED_COMMANDS,
+		    .pipelineStatistics = 0,
+		};
+		context->result.vkResult = vkCreateQueryPool(context->device, &queryPoolInfo, NULL, &sequence->queryPool);
+		culkanCheckError(context);
+	}
+	return sequence;
+}
+
+void culkanBeginSequence(CulkanSequence* sequence) {
+	// The command buffer cannot be recorded while a submission is using it
+	culkanWait(culkanGetSequenceSubmission(sequence));
+
+	CulkanContext* context	 = sequence->context;
+	context->result.vkResult = vkResetCommandBuffer(sequence->commandBuffer, 0);
+	culkanCheckError(context);
+	VkCommandBufferBeginInfo beginInfo = {
 	    .sType	      = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
 	    .pNext	      = NULL,
 	    .flags	      = 0,
 	    .pInheritanceInfo = NULL,
 	};
+	context->result.vkResult = vkBeginCommandBuffer(sequence->commandBuffer, &beginInfo);
+	culkanCheckError(context);
+	if (sequence->queryPool != VK_NULL_HANDLE) {
+		vkCmdResetQueryPool(sequence->commandBuffer, sequence->queryPool, 0, 2 * CULKAN_MAX_TIMED_COMMANDS);
+	}
+	sequence->timedCount = 0;
+	sequence->recording  = 1;
+}
 
-	vkBeginCommandBuffer(culkan->commandBuffer, &culkan->commandBufferBeginInfo);
-	vkCmdBindPipeline(culkan->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culkan->pipeline);
+CulkanResult culkanSequenceDispatch(CulkanSequence* sequence, Culkan* culkan) {
+	// The pipeline and the descriptor set of another device cannot be bound, nor a command buffer that is not recording
+	if (culkan->context != sequence->context) {
+		return (CulkanResult){VK_SUCCESS, WRONG_CONTEXT};
+	}
+	if (!sequence->recording) {
+		return (CulkanResult){VK_SUCCESS, NOT_RECORDING};
+	}
+	if (culkan->commandBuffer == VK_NULL_HANDLE) {
+		return (CulkanResult){VK_SUCCESS, NOT_SET_UP};
+	}
+	vkCmdBindPipeline(sequence->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culkan->pipeline);
 	vkCmdBindDescriptorSets(
-	    culkan->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culkan->pipelineLayout, 0, 1, &culkan->descriptorSet, 0, NULL);
-	vkCmdDispatch(culkan->commandBuffer, 1, 1, 1);
-	vkEndCommandBuffer(culkan->commandBuffer);
+	    sequence->commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, culkan->pipelineLayout, 0, 1, &culkan->descriptorSet, 0, NULL);
+	if (culkan->layout->pushConstantSize != 0) {
+		vkCmdPushConstants(sequence->commandBuffer,
+				   culkan->pipelineLayout,
+				   VK_SHADER_STAGE_COMPUTE_BIT,
+				   0,
+				   culkan->layout->pushConstantSize,
+				   culkan->pushConstantData);
+	}
+	int timed = culkanSequenceBeginTimed(sequence, CULKAN_STAGE_COMPUTE);
+	vkCmdDispatch(sequence->commandBuffer, culkan->groupCount.x, culkan->groupCount.y, culkan->groupCount.z);
+	culkanSequenceEndTimed(sequence, timed);
+	return (CulkanResult){VK_SUCCESS, NO_ERROR};
+}
 
-	culkan->fenceCreateInfo = (VkFenceCreateInfo){
-	    .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-	    .pNext = NULL,
-	    .flags = 0,
-	};
+void culkanSequenceBarrier(CulkanSequence* sequence) {
+	// A global barrier, the buffers of a context are few and a buffer barrier would not be cheaper
+	VkPipelineStageFlags stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	VkAccessFlags writes	    = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+	VkAccessFlags accesses	    = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | writes;
+	culkanSequenceMemoryBarrier(sequence, stages, writes, stages, accesses);
+}
 
-	culkan->result.vkResult = vkCreateFence(culkan->device, &culkan->fenceCreateInfo, NULL, &culkan->computeFence);
-	culkanCheckError(culkan);
+void culkanSequenceCopyBinding(CulkanSequence* sequence, Culkan* src, uint32_t srcBinding, Culkan* dst, uint32_t dstBinding) {
+	GPUVariable* srcVariable = culkanGetBinding(src, srcBinding);
+	GPUVariable* dstVariable = culkanGetBinding(dst, dstBinding);
+	size_t size		 = srcVariable->sizeOfVar < dstVariable->sizeOfVar ? srcVariable->sizeOfVar : dstVariable->sizeOfVar;
+	VkBufferCopy region	 = {.srcOffset = 0, .dstOffset = 0, .size = size};
+	int timed		 = culkanSequenceBeginTimed(sequence, CULKAN_STAGE_COPY);
+	vkCmdCopyBuffer(sequence->commandBuffer, *srcVariable->vkBufferVar, *dstVariable->vkBufferVar, 1, &region);
+	culkanSequenceEndTimed(sequence, timed);
+}
 
-	vkGetDeviceQueue(culkan->device, culkan->family, 0, &culkan->queue);
+void culkanEndSequence(CulkanSequence* sequence) {
+	sequence->context->result.vkResult = vkEndCommandBuffer(sequence->commandBuffer);
+	culkanCheckError(sequence->context);
+	sequence->recording = 0;
 }
 
-void culkanRun(Culkan* culkan) {
-	culkan->commandBuffers	  = culkanMalloc(VkCommandBuffer, 1);
-	culkan->commandBuffers[0] = culkan->commandBuffer;
+void culkanSequenceUpload(CulkanSequence* sequence, Culkan* culkan, uint32_t binding, size_t offset, size_t size) {
+	GPUVariable* variable = culkanGetBinding(culkan, binding);
+	if (!culkanIsMappedMemoryCoherent(variable)) {
+		// The whole mapping, a range would have to be aligned on nonCoherentAtomSize
+		VkMappedMemoryRange range = culkanWholeRange(variable);
+		culkan->result.vkResult	  = vkFlushMappedMemoryRanges(variable->deviceVar, 1, &range);
+		culkanCheckError(culkan);
+	}
+	if (variable->stagingBufferVar != VK_NULL_HANDLE) {
+		VkBufferCopy region = {.srcOffset = offset, .dstOffset = offset, .size = size};
+		int timed	    = culkanSequenceBeginTimed(sequence, CULKAN_STAGE_UPLOAD);
+		vkCmdCopyBuffer(sequence->commandBuffer, variable->stagingBufferVar, *variable->vkBufferVar, 1, &region);
+		culkanSequenceEndTimed(sequence, timed);
+	}
+}
+
+void culkanSequenceDownload(CulkanSequence* sequence, Culkan* culkan, uint32_t binding, size_t offset, size_t size) {
+	GPUVariable* variable = culkanGetBinding(culkan, binding);
+	if (variable->stagingBufferVar != VK_NULL_HANDLE) {
+		VkBufferCopy region = {.srcOffset = offset, .dstOffset = offset, .size = size};
+		int timed	    = culkanSequenceBeginTimed(sequence, CULKAN_STAGE_DOWNLOAD);
+		vkCmdCopyBuffer(sequence->commandBuffer, *variable->vkBufferVar, variable->stagingBufferVar, 1, &region);
+		culkanSequenceEndTimed(sequence, timed);
+	}
+	// The writes of the device, by the copy or by the dispatches, are made available to the host
+	culkanSequenceMemoryBarrier(sequence,
+				    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+				    VK_PIPELINE_STAGE_HOST_BIT,
+				    VK_ACCESS_HOST_READ_BIT);
+}
+
+void culkanInvalidateMappedBinding(Culkan* culkan, uint32_t binding) {
+	GPUVariable* variable = culkanGetBinding(culkan, binding);
+	if (!culkanIsMappedMemoryCoherent(variable)) {
+		VkMappedMemoryRange range = culkanWholeRange(variable);
+		culkan->result.vkResult	  = vkInvalidateMappedMemoryRanges(variable->deviceVar, 1, &range);
+		culkanCheckError(culkan);
+	}
+}
+
+CulkanSubmission culkanSubmitSequence(CulkanSequence* sequence) {
+	return culkanSubmitSequenceAfter(sequence, NULL, 0);
+}
 
+CulkanSubmission culkanSubmitSequenceAfter(CulkanSequence* sequence, const CulkanSubmission* waits, uint32_t waitCount) {
+	CulkanContext* context = sequence->context;
+	culkanWait(culkanGetSequenceSubmission(sequence));
+	if (sequence->recording) {
+		culkanEndSequence(sequence);
+	}
+
+	// The timeline only increases, so waiting for the greatest value of the pending sequences waits for all of them
+	uint64_t waitValue = 0;
+	for (uint32_t i = 0; i < waitCount; i++) {
+		if (waits[i].context != context) {
+			context->result.ckResult = WRONG_CONTEXT;
+			culkanCheckErrorWithMessage(context, "A sequence cannot wait for a submission of another context");
+			continue;
+		}
+		if (!*waits[i].pending) {
+			continue;
+		}
+		if (waits[i].fence != VK_NULL_HANDLE) {
+			culkanWait(waits[i]);
+		}
+		else if (waits[i].value > waitValue) {
+			waitValue = waits[i].value;
+		}
+	}
+
+	culkanSubmitUploads(context);
+	sequence->pending = 1;
+	if (sequence->fence != VK_NULL_HANDLE) {
+		culkanSubmitCommandBuffer(context, sequence->commandBuffer, sequence->fence);
+		return culkanGetSequenceSubmission(sequence);
+	}
+
+	sequence->value				   = ++context->timelineValue;
+	VkPipelineStageFlags waitStages		   = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	uint32_t timelineWaitCount		   = waitValue != 0 ? 1 : 0;
+	VkTimelineSemaphoreSubmitInfo timelineInfo = {
+	    .sType		       = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+	    .pNext		       = NULL,
+	    .waitSemaphoreValueCount   = timelineWaitCount,
+	    .pWaitSemaphoreValues      = &waitValue,
+	    .signalSemaphoreValueCount = 1,
+	    .pSignalSemaphoreValues    = &sequence->value,
+	};
 	VkSubmitInfo submitInfo = {
 	    .sType		  = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-	    .pNext		  = NULL,
-	    .waitSemaphoreCount	  = 0,
-	    .pWaitSemaphores	  = NULL,
-	    .pWaitDstStageMask	  = NULL,
+	    .pNext		  = &timelineInfo,
+	    .waitSemaphoreCount	  = timelineWaitCount,
+	    .pWaitSemaphores	  = &context->timeline,
+	    .pWaitDstStageMask	  = &waitStages,
 	    .commandBufferCount	  = 1,
-	    .pCommandBuffers	  = culkan->commandBuffers,
-	    .signalSemaphoreCount = 0,
-	    .pSignalSemaphores	  = NULL,
+	    .pCommandBuffers	  = &sequence->commandBuffer,
+	    .signalSemaphoreCount = 1,
+	    .pSignalSemaphores	  = &context->timeline,
 	};
-
-	vkQueueSubmit(culkan->queue, 1, &submitInfo, culkan->computeFence);
-	vkWaitForFences(culkan->device, 1, &culkan->computeFence, VK_TRUE, UINT64_MAX);
-	vkDestroyFence(culkan->device, culkan->computeFence, NULL);
+	context->result.vkResult = vkQueueSubmit(context->queue, 1, &submitInfo, VK_NULL_HANDLE);
+	culkanCheckError(context);
+	return culkanGetSequenceSubmission(sequence);
 }
 
-void culkanDestroy(Culkan* culkan) {
-	free(culkan->shaderBuffer);
-	vkDestroyShaderModule(culkan->device, culkan->shaderModule, NULL);
-	vkDestroyPipeline(culkan->device, culkan->pipeline, NULL);
-	vkDestroyPipelineLayout(culkan->device, culkan->pipelineLayout, NULL);
-	vkDestroyDescriptorPool(culkan->device, culkan->descriptorPool, NULL);
-	vkDestroyDescriptorSetLayout(culkan->device, culkan->descriptorSetLayout, NULL);
-	vkDestroyDevice(culkan->device, NULL);
-	vkDestroyInstance(culkan->instance, NULL);
-	free(culkan->physicalDevices);
-	free(culkan->queueFamilies);
+int culkanGetSequenceTimes(CulkanSequence* sequence, CulkanStageTimes* times) {
+	CulkanContext* context = sequence->context;
+	memset(times, 0, sizeof(*times));
+	if (sequence->queryPool == VK_NULL_HANDLE) {
+		return 0;
+	}
+	culkanWait(culkanGetSequenceSubmission(sequence));
+	if (sequence->timedCount == 0) {
+		return 1;
+	}
 
-	for (uint32_t i = 0; i < culkan->layout->bindingCount; i++) {
-		freeGPUVariableData(&culkan->variables[i]);
+	uint64_t timestamps[2 * CULKAN_MAX_TIMED_COMMANDS];
+	context->result.vkResult = vkGetQueryPoolResults(context->device,
+							 sequence->queryPool,
+							 0,
+							 2 * sequence->timedCount,
+							 sizeof(timestamps),
+							 timestamps,
+							 sizeof(uint64_t),
+							 VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+	culkanCheckError(context);
+
+	// Ticks of timestampPeriod nanoseconds, the difference is masked in case the counter wrapped around
+	double period = (double)context->deviceProperties.limits.timestampPeriod * 1e-9;
+	for (uint32_t i = 0; i < sequence->timedCount; i++) {
+		uint64_t ticks = (timestamps[2 * i + 1] - timestamps[2 * i]) & context->timestampMask;
+		times->seconds[sequence->timedStages[i]] += (double)ticks * period;
+		times->commands[sequence->timedStages[i]]++;
 	}
+	return 1;
+}
 
-	free(culkan->variables);
-	free(culkan);
+void culkanDestroySequence(CulkanSequence* sequence) {
+	CulkanContext* context = sequence->context;
+	culkanWait(culkanGetSequenceSubmission(sequence));
+	if (sequence->queryPool != VK_NULL_HANDLE) {
+		vkDestroyQueryPool(context->device, sequence->queryPool, NULL);
+	}
+	if (sequence->fence != VK_NULL_HANDLE) {
+		vkDestroyFence(context->device, sequence->fence, NULL);
+	}
+	vkFreeCommandBuffers(context->device, context->commandPool, 1, &sequence->commandBuffer);
+	free(sequence);
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,94 @@
+"""
+@file scripts/shape_sweep_heatmap.py
+@brief Script to run the shape sweep benchmark and plot the GFLOP/s of every kernel and shape as a heat map.
+"""
+
+# For running the benchmark
+import subprocess
+
+# For plotting the results
+import matplotlib.pyplot as plt
+
+
+# Build the benchmark executable
+subprocess.run(["cmake", "-S", ".", "-B", "build", "-DCMAKE_BUILD_TYPE=Release"])
+subprocess.run(["cmake", "--build", "build"])
+
+def launch() -> str:
+	"""
+	Launch the shape sweep benchmark and return the output.
+	"""
+	result = subprocess.run(
+		["./build/benchmarks/top.shape_sweep"],
+		stdout=subprocess.PIPE,
+		stderr=subprocess.PIPE,
+	)
+	stdout, stderr = result.stdout.decode("utf-8"), result.stderr.decode("utf-8")
+
+	# Check for errors
+	if stderr != "":
+		print("Error:", stderr)
+
+	print(stdout)
+	return stdout
+
+def parse_output(output: str) -> tuple:
+	"""
+	Parse the output of the benchmark and return a dictionary {kernel: {shape: GFLOP/s}}, and one {shape: kernel} of the
+	kernels chosen by the dispatcher.
+	"""
+	# Output format:
+	# Kernel | kind mxnxk, Min: Xs, Max: Ys, Med: Zs, GFLOP/s: G, ...
+	# Dispatched to kernel for kind mxnxk
+
+	results = {}
+	dispatched = {}
+	for line in output.split("\n"):
+		if line.startswith("Dispatched to "):
+			kernel, shape = line[len("Dispatched to "):].split(" for ")
+			dispatched[shape.strip()] = kernel
+			continue
+		if " | " not in line:
+			continue
+		values = line.split(",")
+		kernel, shape = values[0].split(" | ")
+		for value in values:
+			if "GFLOP/s:" in value and "Roofline" not in value:
+				results.setdefault(kernel, {})[shape] = float(value.split(":")[1].strip())
+	return results, dispatched
+
+results, dispatched = parse_output(launch())
+
+kernels = list(results.keys())
+shapes = []
+for kernel in kernels:
+	for shape in results[kernel]:
+		if shape not in shapes:
+			shapes.append(shape)
+
+gflops = [[results[kernel].get(shape, float("nan")) for shape in shapes] for kernel in kernels]
+
+# Plot the heat map, one row per kernel and one column per shape
+fig, ax = plt.subplots(figsize=(18, 5))
+image = ax.imshow(gflops, cmap="viridis", aspect="auto")
+ax.set_xticks(range(len(shapes)))
+ax.set_xticklabels(shapes, rotation=45, ha="right", fontsize=11)
+ax.set_yticks(range(len(kernels)))
+ax.set_yticklabels(kernels, fontsize=13)
+for i in range(len(kernels)):
+	for j in range(len(shapes)):
+		# The cells of the dispatcher also name the kernel it chose
+		label = f"{gflops[i][j]:.1f}"
+		if kernels[i] == "Dispatched" and shapes[j] in dispatched:
+			label += f"\n{dispatched[shapes[j]]}"
+		ax.text(j, i, label, ha="center", va="center", color="white", fontsize=9)
+colorbar = fig.colorbar(image, ax=ax)
+colorbar.set_label("GFLOP/s", fontsize=14)
+
+# Save the plot and write the results to a file
+plt.tight_layout()
+plt.savefig("results/shape_sweep.svg")
+plt.savefig("results/shape_sweep.png")
+with open("results/shape_sweep.log", "w") as f:
+	for kernel in kernels:
+		f.write(f"{kernel}: {results[kernel]}\n")
@@ -0,0 +1,171 @@
+/**
+ * @file src/cache_model.hpp
+ * @brief Analytical model of the cache hierarchy, choosing the block and tile sizes of the cache blocked kernels
+ * from the cache sizes and associativities given by sysfs, without benchmarking at startup.
+ */
+
+#ifndef TOP_CACHE_MODEL_HPP
+#define TOP_CACHE_MODEL_HPP
+
+#include "matrix_product.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+struct CacheLevel {
+	size_t size;	 // Bytes, 0 if the level does not exist
+	int ways;	 // Associativity
+	int line_size;	 // Bytes
+	int shared_cpus; // Number of logical CPUs sharing this cache
+};
+
+struct CacheHierarchy {
+	CacheLevel l1d;
+	CacheLevel l2;
+	CacheLevel l3;
+};
+
+/**
+ * @brief Parses a sysfs size such as "48K" or "2048K" into bytes
+ */
+inline auto parse_cache_size(std::string const& text) -> size_t {
+	size_t size = 0;
+	size_t i    = 0;
+	while (i < text.size() && text[i] >= '0' && text[i] <= '9') {
+		size = size * 10 + size_t(text[i] - '0');
+		i++;
+	}
+	if (i < text.size()) {
+		switch (text[i]) {
+			case 'K':
+				return size << 10;
+			case 'M':
+				return size << 20;
+			case 'G':
+				return size << 30;
+		}
+	}
+	return size;
+}
+
+/**
+ * @brief Number of CPUs in a sysfs CPU list such as "0-1,8-9"
+ */
+inline auto count_cpu_list(std::string const& list) -> int {
+	int count = 0;
+	std::istringstream ranges(list);
+	std::string range;
+	while (std::getline(ranges, range, ',')) {
+		int first = 0;
+		int last  = 0;
+		char dash = 0;
+		std::istringstream bounds(range);
+		if (!(bounds >> first)) {
+			continue;
+		}
+		last = (bounds >> dash >> last) ? last : first;
+		count += last - first + 1;
+	}
+	return std::max(count, 1);
+}
+
+/**
+ * @brief Reads the data caches of a CPU from sysfs.
+ * Levels that cannot be read keep common values (32 KiB 8-way L1, 1 MiB 16-way L2, no L3).
+ */
+inline auto read_cache_hierarchy(std::string const& path = "/sys/devices/system/cpu/cpu0/cache") -> CacheHierarchy {
+	CacheHierarchy caches{
+	    .l1d = {32 << 10, 8, 64, 1},
+	    .l2	 = {1 << 20, 16, 64, 1},
+	    .l3	 = {0, 1, 64, 1},
+	};
+
+	auto read = [](std::string const& file) {
+		std::ifstream stream(file);
+		std::string value;
+		std::getline(stream, value);
+		return value;
+	};
+
+	for (int index = 0;; index++) {
+		auto dir   = fmt::format("{}/index{}", path, index);
+		auto level = read(dir + "/level");
+		if (level.empty()) {
+			break;
+		}
+		if (read(dir + "/type") == "Instruction") {
+			continue;
+		}
+
+		CacheLevel cache{
+		    .size	 = parse_cache_size(read(dir + "/size")),
+		    .ways	 = std::max(1, std::atoi(read(dir + "/ways_of_associativity").c_str())),
+		    .line_size	 = std::max(1, std::atoi(read(dir + "/coherency_line_size").c_str())),
+		    .shared_cpus = count_cpu_list(read(dir + "/shared_cpu_list")),
+		};
+		if (cache.size == 0) {
+			continue;
+		}
+		if (level == "1") {
+			caches.l1d = cache;
+		}
+		else if (level == "2") {
+			caches.l2 = cache;
+		}
+		else if (level == "3") {
+			caches.l3 = cache;
+		}
+	}
+	return caches;
+}
+
+/**
+ * @brief Bytes of a cache that one thread can count on.
+ * One way is left to the data streamed through the cache, so that it does not evict the blocks,
+ * and a shared cache is split between the CPUs sharing it.
+ */
+inline auto usable_cache_size(CacheLevel const& cache) -> size_t {
+	size_t usable = cache.ways > 1 ? cache.size / size_t(cache.ways) * size_t(cache.ways - 1) : cache.size / 2;
+	return usable / size_t(cache.shared_cpus);
+}
+
+/**
+ * @brief Tile sizes of matrix_product_cache_blocked_tiles:
+ * - kc: a row segment of A and a column segment of B, kc doubles each, fit in half of L1 (the other half for the rest),
+ * - nc: the kc x nc block of B, reused by all the rows of a tile, fits in L2,
+ * - mc: the mc x kc block of A, reused by all the column blocks, fits in this thread's share of L3 (L2 without L3),
+ *   and is small enough that each of the threads gets a tile of the m rows.
+ * All of them are multiples of a cache line of doubles.
+ */
+inline auto model_tile_sizes(CacheHierarchy const& caches, int m, int threads) -> TileSizes {
+	constexpr size_t LINE = 64 / sizeof(double);
+	auto round_down	      = [&](size_t elements) { return int(std::max(LINE, elements / LINE * LINE)); };
+
+	CacheLevel const& outer = caches.l3.size != 0 ? caches.l3 : caches.l2;
+	size_t kc		= usable_cache_size(caches.l1d) / 2 / (2 * sizeof(double));
+	size_t nc		= usable_cache_size(caches.l2) / (round_down(kc) * sizeof(double));
+	size_t mc		= usable_cache_size(outer) / (round_down(kc) * sizeof(double));
+	mc			= std::min(mc, (size_t(std::max(m, 1)) + size_t(std::max(threads, 1)) - 1) / size_t(std::max(threads, 1)));
+	return TileSizes{.mc = round_down(mc), .nc = round_down(nc), .kc = round_down(kc)};
+}
+
+/**
+ * @brief Block size of the square cache blocked kernels (i, ij, ijk) for a product with an inner dimension k.
+ * A block row of A and a block column of B, block_size x k doubles each, fit in L2.
+ * It is a power of two between 4 and 128, the range of the empirical sweeps.
+ */
+inline auto model_block_size(CacheHierarchy const& caches, int k) -> int {
+	size_t fitting = usable_cache_size(caches.l2) / (2 * size_t(std::max(k, 1)) * sizeof(double));
+	int block_size = 4;
+	while (block_size < 128 && size_t(block_size * 2) <= fitting) {
+		block_size *= 2;
+	}
+	return block_size;
+}
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * @file src/kernels.hpp
+ * @brief Selection of the matrix product kernels by name, and dispatch of each shape to its fastest kernel.
+ */
+
+#ifndef TOP_KERNELS_HPP
+#define TOP_KERNELS_HPP
+
+#include "cache_model.hpp"
+#include "matrix_product.hpp"
+#include "matrix_product_cblas.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+/**
+ * @brief The matrix product kernels of matrix_product.hpp
+ */
+enum class Kernel {
+	Reference,
+	CacheBlockedI,
+	CacheBlockedIJ,
+	CacheBlockedIJK,
+	CacheBlockedTiles,
+#ifdef TOP_HAVE_CBLAS
+	Cblas,
+#endif
+};
+
+struct KernelInfo {
+	Kernel kernel;
+	std::string_view name; // Name used on the command line
+	bool blocked;	       // Whether the kernel takes a block size
+};
+
+constexpr KernelInfo KERNELS[] = {
+    {Kernel::Reference, "reference", false},
+    {Kernel::CacheBlockedI, "i", true},
+    {Kernel::CacheBlockedIJ, "ij", true},
+    {Kernel::CacheBlockedIJK, "ijk", true},
+    {Kernel::CacheBlockedTiles, "tiles", false}, // Tile sizes from the cache model
+#ifdef TOP_HAVE_CBLAS
+    {Kernel::Cblas, "cblas", false},
+#endif
+};
+
+inline auto kernel_info(Kernel kernel) -> KernelInfo const& {
+	for (auto const& info : KERNELS) {
+		if (info.kernel == kernel) {
+			return info;
+		}
+	}
+	std::abort();
+}
+
+inline auto kernel_from_name(std::string_view name) -> std::optional<Kernel> {
+	for (auto const& info : KERNELS) {
+		if (info.name == name) {
+			return info.kernel;
+		}
+	}
+	return std::nullopt;
+}
+
+/**
+ * @brief Name of a kernel run in the benchmark results, in the same format as the original benchmarks
+ */
+inline auto kernel_label(Kernel kernel, int block_size) -> std::string {
+	auto const& info = kernel_info(kernel);
+#ifdef TOP_HAVE_CBLAS
+	if (kernel == Kernel::Cblas) {
+		return "CBLAS";
+	}
+#endif
+	if (kernel == Kernel::CacheBlockedTiles) {
+		return "Cache Blocked tiles";
+	}
+	if (!info.blocked) {
+		return "No Cache Blocking";
+	}
+	return fmt::format("Cache Blocked {}{}", info.name, block_size);
+}
+
+/**
+ * @brief Tile sizes given by the cache model for this machine, for a product with m rows
+ */
+inline auto machine_tile_sizes(int m) -> TileSizes {
+	static CacheHierarchy const caches = read_cache_hierarchy();
+	return model_tile_sizes(caches, m, Kokkos::DefaultExecutionSpace().concurrency());
+}
+
+/**
+ * @brief Runs a kernel on the given matrices
+ */
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto kernel_run(Kernel kernel, double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C, int block_size)
+    -> void {
+	switch (kernel) {
+		case Kernel::Reference:
+			matrix_product_reference(alpha, A, B, beta, C);
+			return;
+		case Kernel::CacheBlockedI:
+			matrix_product_cache_blocked_i(alpha, A, B, beta, C, block_size);
+			return;
+		case Kernel::CacheBlockedIJ:
+			matrix_product_cache_blocked_ij(alpha, A, B, beta, C, block_size);
+			return;
+		case Kernel::CacheBlockedIJK:
+			matrix_product_cache_blocked_ijk(alpha, A, B, beta, C, block_size);
+			return;
+		case Kernel::CacheBlockedTiles:
+			matrix_product_cache_blocked_tiles(alpha, A, B, beta, C, machine_tile_sizes(int(C.extent(0))));
+			return;
+#ifdef TOP_HAVE_CBLAS
+		case Kernel::Cblas:
+			matrix_product_cblas(alpha, A, B, beta, C);
+			return;
+#endif
+	}
+}
+
+/**
+ * @brief Routes each product to the fastest kernel for its shape.
+ * The first product of a shape times every candidate several times on a copy of C and compares their median times,
+ * so that a single preempted or cold run does not decide; the choice is kept for the next products of the shape.
+ */
+class KernelDispatcher {
+      public:
+	explicit KernelDispatcher(int block_size = 32, int repetitions = 5)
+	    : block_size(block_size), repetitions(std::max(1, repetitions)) {}
+
+	template <class AMatrixType, class BMatrixType, class CMatrixType>
+	auto run(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C) -> Kernel {
+		Shape shape{int(C.extent(0)), int(C.extent(1)), int(A.extent(1))};
+		auto found = choices.find(shape);
+		if (found == choices.end()) {
+			found = choices.emplace(shape, fastest(alpha, A, B, beta, C)).first;
+		}
+		kernel_run(found->second, alpha, A, B, beta, C, block_size);
+		return found->second;
+	}
+
+      private:
+	using Shape = std::tuple<int, int, int>;
+
+	// ijk is never the fastest and would make the first call of each shape much slower
+	static constexpr Kernel CANDIDATES[] = {
+	    Kernel::Reference,
+	    Kernel::CacheBlockedIJ,
+#ifdef TOP_HAVE_CBLAS
+	    Kernel::Cblas,
+#endif
+	};
+
+	/**
+	 * @brief Median time of repetitions runs of a kernel, C being restored before each of them
+	 */
+	template <class AMatrixType, class BMatrixType, class CMatrixType, class ScratchType>
+	auto median_time(Kernel kernel, double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType const& C,
+			 ScratchType& scratch) -> double {
+		std::vector<double> times;
+		for (int repetition = 0; repetition < repetitions; ++repetition) {
+			Kokkos::deep_copy(scratch, C);
+			Kokkos::Timer timer;
+			kernel_run(kernel, alpha, A, B, beta, scratch, block_size);
+			Kokkos::fence();
+			times.push_back(timer.seconds());
+		}
+		auto middle = times.begin() + times.size() / 2;
+		std::nth_element(times.begin(), middle, times.end());
+		return *middle;
+	}
+
+	template <class AMatrixType, class BMatrixType, class CMatrixType>
+	auto fastest(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType const& C) -> Kernel {
+		auto scratch	 = Kokkos::create_mirror(C);
+		Kernel best	 = CANDIDATES[0];
+		double best_time = std::numeric_limits<double>::infinity();
+		for (auto kernel : CANDIDATES) {
+			double time = median_time(kernel, alpha, A, B, beta, C, scratch);
+			if (time < best_time) {
+				best	  = kernel;
+				best_time = time;
+			}
+		}
+		return best;
+	}
+
+	int block_size;
+	int repetitions; // Timed runs of each candidate
+	std::map<Shape, Kernel> choices;
+};
+
+#endif
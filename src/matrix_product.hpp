@@ -6,8 +6,13 @@
 #ifndef TOP_MATRIX_PRODUCT_HPP
 #define TOP_MATRIX_PRODUCT_HPP
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <type_traits>
 
 #include <Kokkos_Core.hpp>
 #include <fmt/core.h>
@@ -15,6 +20,37 @@
 using RightMatrix = Kokkos::View<double**, Kokkos::LayoutRight>;
 using LeftMatrix  = Kokkos::View<double**, Kokkos::LayoutLeft>;
 
+// Matrix with a padded leading dimension, see padded_right_matrix() and padded_left_matrix()
+using StrideMatrix = Kokkos::View<double**, Kokkos::LayoutStride>;
+
+/**
+ * @brief Leading dimension for rows (or columns) of extent elements, so that consecutive rows do not alias in the cache.
+ * It is rounded up to a cache line, and one more cache line is added when it is a multiple of 512 bytes,
+ * because the rows would then only map onto a fraction of the sets of the cache.
+ */
+inline auto padded_leading_dimension(int extent) -> int {
+	constexpr int LINE = 64 / sizeof(double);
+	int ld		   = (extent + LINE - 1) / LINE * LINE;
+	if (ld % (8 * LINE) == 0) {
+		ld += LINE;
+	}
+	return ld;
+}
+
+/**
+ * @brief Allocates a row-major matrix whose rows are padded to padded_leading_dimension(cols)
+ */
+inline auto padded_right_matrix(std::string const& label, int rows, int cols) -> StrideMatrix {
+	return StrideMatrix(label, Kokkos::LayoutStride(rows, padded_leading_dimension(cols), cols, 1));
+}
+
+/**
+ * @brief Allocates a column-major matrix whose columns are padded to padded_leading_dimension(rows)
+ */
+inline auto padded_left_matrix(std::string const& label, int rows, int cols) -> StrideMatrix {
+	return StrideMatrix(label, Kokkos::LayoutStride(rows, 1, cols, padded_leading_dimension(rows)));
+}
+
 template <class MatrixType> auto matrix_init(MatrixType& M) -> void {
 	static_assert(2 == MatrixType::rank(), "View must be of rank 2");
 
@@ -26,6 +62,22 @@ template <class MatrixType> auto matrix_init(MatrixType& M) -> void {
 	    });
 }
 
+/**
+ * @brief Letter of the layout of a matrix in the kernel labels, r for right, l for left and s for strided
+ */
+template <class MatrixType> constexpr auto layout_letter() -> char {
+	using Layout = typename MatrixType::array_layout;
+	if constexpr (std::is_same_v<Layout, Kokkos::LayoutRight>) {
+		return 'r';
+	}
+	else if constexpr (std::is_same_v<Layout, Kokkos::LayoutLeft>) {
+		return 'l';
+	}
+	else {
+		return 's';
+	}
+}
+
 template <class AMatrixType, class BMatrixType, class CMatrixType>
 auto matrix_product_reference(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C) -> void {
 	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
@@ -33,8 +85,11 @@ auto matrix_product_reference(double alpha, AMatrixType const& A, BMatrixType co
 	assert(B.extent(1) == C.extent(1));
 	assert(A.extent(1) == B.extent(0));
 
+	// Label of the kernel in Kokkos Tools, with the layouts of A, B and C
+	auto label = fmt::format(
+	    "dgemm_reference_A{}_B{}_C{}", layout_letter<AMatrixType>(), layout_letter<BMatrixType>(), layout_letter<CMatrixType>());
 	Kokkos::parallel_for(
-	    "dgemm_kernel", A.extent(0), KOKKOS_LAMBDA(int i) {
+	    label, A.extent(0), KOKKOS_LAMBDA(int i) {
 		    for (int j = 0; j < int(B.extent(1)); ++j) {
 			    double acc = 0.0;
 			    for (int k = 0; k < int(A.extent(1)); ++k) {
@@ -45,15 +100,16 @@ auto matrix_product_reference(double alpha, AMatrixType const& A, BMatrixType co
 	    });
 }
 
-auto matrix_product_cache_blocked_i(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix& C, int block_size)
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_cache_blocked_i(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C, int block_size)
     -> void {
-	static_assert(RightMatrix::rank() == 2 && LeftMatrix::rank() == 2, "Views must be of rank 2");
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
 	assert(A.extent(0) == C.extent(0));
 	assert(B.extent(1) == C.extent(1));
 	assert(A.extent(1) == B.extent(0));
 
 	Kokkos::parallel_for(
-	    "dgemm_kernel", (A.extent(0) + block_size) / block_size, KOKKOS_LAMBDA(int _bi) {
+	    fmt::format("dgemm_cache_blocked_i_b{}", block_size), (A.extent(0) + block_size) / block_size, KOKKOS_LAMBDA(int _bi) {
 		    int bi = _bi * block_size;
 		    for (int j = 0; j < int(B.extent(1)); j += 1) {
 
@@ -69,15 +125,16 @@ auto matrix_product_cache_blocked_i(double alpha, RightMatrix const& A, LeftMatr
 	    });
 }
 
-auto matrix_product_cache_blocked_ij(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix& C, int block_size)
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_cache_blocked_ij(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C, int block_size)
     -> void {
-	static_assert(RightMatrix::rank() == 2 && LeftMatrix::rank() == 2, "Views must be of rank 2");
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
 	assert(A.extent(0) == C.extent(0));
 	assert(B.extent(1) == C.extent(1));
 	assert(A.extent(1) == B.extent(0));
 
 	Kokkos::parallel_for(
-	    "dgemm_kernel", (A.extent(0) + block_size) / block_size, KOKKOS_LAMBDA(int _bi) {
+	    fmt::format("dgemm_cache_blocked_ij_b{}", block_size), (A.extent(0) + block_size) / block_size, KOKKOS_LAMBDA(int _bi) {
 		    int bi = _bi * block_size;
 		    for (int bj = 0; bj < int(B.extent(1)); bj += block_size) {
 
@@ -96,15 +153,16 @@ auto matrix_product_cache_blocked_ij(double alpha, RightMatrix const& A, LeftMat
 	    });
 }
 
-auto matrix_product_cache_blocked_ijk(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix& C, int block_size)
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_cache_blocked_ijk(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C, int block_size)
     -> void {
-	static_assert(RightMatrix::rank() == 2 && LeftMatrix::rank() == 2, "Views must be of rank 2");
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
 	assert(A.extent(0) == C.extent(0));
 	assert(B.extent(1) == C.extent(1));
 	assert(A.extent(1) == B.extent(0));
 
 	Kokkos::parallel_for(
-	    "dgemm_kernel", (A.extent(0) + block_size) / block_size, KOKKOS_LAMBDA(int _bi) {
+	    fmt::format("dgemm_cache_blocked_ijk_b{}", block_size), (A.extent(0) + block_size) / block_size, KOKKOS_LAMBDA(int _bi) {
 		    int bi	     = _bi * block_size;
 		    RightMatrix accs = RightMatrix("accs", block_size, block_size); // Accumulator for elements of the block
 		    for (int bj = 0; bj < int(B.extent(1)); bj += block_size) {
@@ -136,6 +194,159 @@ auto matrix_product_cache_blocked_ijk(double alpha, RightMatrix const& A, LeftMa
 	    });
 }
 
+/**
+ * @brief Tile sizes of matrix_product_cache_blocked_tiles, along the rows of C (mc), the columns of C (nc) and the inner dimension (kc)
+ */
+struct TileSizes {
+	int mc;
+	int nc;
+	int kc;
+};
+
+/**
+ * @brief Cache blocked product with separate tile sizes along m, n and k, chosen by model_tile_sizes() of cache_model.hpp.
+ * C can only be scaled once the whole inner dimension is summed, so the partial sums of a tile go through an mc x nc
+ * accumulator in the scratch memory of the team (a single thread) computing it, and C is scaled once per tile.
+ */
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_cache_blocked_tiles(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C, TileSizes tiles)
+    -> void {
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
+	assert(A.extent(0) == C.extent(0));
+	assert(B.extent(1) == C.extent(1));
+	assert(A.extent(1) == B.extent(0));
+
+	using Policy	  = Kokkos::TeamPolicy<>;
+	using ScratchTile = Kokkos::View<double**,
+					 Kokkos::LayoutRight,
+					 Kokkos::DefaultExecutionSpace::scratch_memory_space,
+					 Kokkos::MemoryUnmanaged>;
+
+	int m	    = int(C.extent(0));
+	int n	    = int(C.extent(1));
+	int k	    = int(A.extent(1));
+	auto policy = Policy((m + tiles.mc - 1) / tiles.mc, 1);
+	policy.set_scratch_size(0, Kokkos::PerTeam(ScratchTile::shmem_size(tiles.mc, tiles.nc)));
+
+	Kokkos::parallel_for(
+	    fmt::format("dgemm_cache_blocked_tiles_m{}_n{}_k{}", tiles.mc, tiles.nc, tiles.kc),
+	    policy,
+	    KOKKOS_LAMBDA(Policy::member_type const& team) {
+		    int bi = team.league_rank() * tiles.mc;
+		    int ei = std::min(bi + tiles.mc, m);
+		    ScratchTile sums(team.team_scratch(0), tiles.mc, tiles.nc);
+		    for (int bj = 0; bj < n; bj += tiles.nc) {
+			    int ej = std::min(bj + tiles.nc, n);
+			    for (int i = bi; i < ei; i++) {
+				    for (int j = bj; j < ej; j++) {
+					    sums(i - bi, j - bj) = 0.0;
+				    }
+			    }
+
+			    for (int bk = 0; bk < k; bk += tiles.kc) {
+				    int ek = std::min(bk + tiles.kc, k);
+
+				    // Tile (i, j), partial sum over the tile k
+				    for (int i = bi; i < ei; i++) {
+					    for (int j = bj; j < ej; j++) {
+						    double acc = 0.0;
+						    for (int l = bk; l < ek; l++) {
+							    acc += A(i, l) * B(l, j);
+						    }
+						    sums(i - bi, j - bj) += acc;
+					    }
+				    }
+			    }
+
+			    // Do the final multiplication once the whole k dimension of the tile is summed
+			    for (int i = bi; i < ei; i++) {
+				    for (int j = bj; j < ej; j++) {
+					    C(i, j) *= beta + (alpha * sums(i - bi, j - bj));
+				    }
+			    }
+		    }
+	    });
+}
+
+/**
+ * @brief Error statistics between two matrices of the same shape, as computed by matrix_compare.
+ */
+struct MatrixComparison {
+	double max_abs_error	  = 0.0; // Largest |A(i, j) - B(i, j)|
+	double max_rel_error	  = 0.0; // Largest |A(i, j) - B(i, j)| / max(|A(i, j)|, |B(i, j)|)
+	uint64_t max_ulp_distance = 0;	 // Largest number of representable doubles between A(i, j) and B(i, j)
+	size_t mismatches	  = 0;	 // Number of elements outside of the tolerance
+};
+
+/**
+ * @brief Maps the sign-magnitude representation of a double onto a monotonic unsigned scale, with +0 and -0 at the same point.
+ */
+KOKKOS_INLINE_FUNCTION auto double_to_ordered_bits(double x) -> uint64_t {
+	constexpr uint64_t SIGN_BIT = uint64_t(1) << 63;
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	return (bits & SIGN_BIT) ? SIGN_BIT - (bits & ~SIGN_BIT) : SIGN_BIT + bits;
+}
+
+/**
+ * @brief Number of representable doubles between a and b, saturated for NaNs.
+ */
+KOKKOS_INLINE_FUNCTION auto ulp_distance(double a, double b) -> uint64_t {
+	if (a != a || b != b) {
+		return UINT64_MAX;
+	}
+	uint64_t oa = double_to_ordered_bits(a);
+	uint64_t ob = double_to_ordered_bits(b);
+	return oa > ob ? oa - ob : ob - oa;
+}
+
+/**
+ * @brief Compares two matrices in a single parallel pass.
+ * An element is a mismatch if its error is above both the absolute tolerance and the relative tolerance
+ * scaled by the magnitude of the element, so that large values are not held to an absolute epsilon.
+ * @param rel_tol relative tolerance
+ * @param abs_tol absolute tolerance, for elements close to 0
+ */
+template <class AMatrixType, class BMatrixType>
+auto matrix_compare(AMatrixType const& A, BMatrixType const& B, double rel_tol = 1e-10, double abs_tol = 1e-10) -> MatrixComparison {
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2, "Views must be of rank 2");
+	assert(A.extent(0) == B.extent(0));
+	assert(A.extent(1) == B.extent(1));
+
+	MatrixComparison result;
+	if (A.extent(0) == 0 || A.extent(1) == 0) {
+		return result;
+	}
+
+	Kokkos::parallel_reduce(
+	    "matrix_compare",
+	    A.extent(0),
+	    KOKKOS_LAMBDA(int i, double& max_abs, double& max_rel, uint64_t& max_ulp, size_t& mismatches) {
+		    for (int j = 0; j < int(A.extent(1)); j++) {
+			    double a	 = A(i, j);
+			    double b	 = B(i, j);
+			    double error = std::abs(a - b);
+			    double scale = std::max(std::abs(a), std::abs(b));
+			    double rel	 = scale > 0.0 ? error / scale : 0.0;
+			    uint64_t ulp = ulp_distance(a, b);
+
+			    max_abs = std::max(max_abs, error);
+			    max_rel = std::max(max_rel, rel);
+			    max_ulp = std::max(max_ulp, ulp);
+			    // Written so that NaNs are always counted as mismatches
+			    if (!(error <= abs_tol || error <= rel_tol * scale)) {
+				    mismatches++;
+			    }
+		    }
+	    },
+	    Kokkos::Max<double>(result.max_abs_error),
+	    Kokkos::Max<double>(result.max_rel_error),
+	    Kokkos::Max<uint64_t>(result.max_ulp_distance),
+	    Kokkos::Sum<size_t>(result.mismatches));
+
+	return result;
+}
+
 template <class AMatrixType, class BMatrixType> auto matrix_are_equal(AMatrixType& A, BMatrixType& B) -> bool {
 	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2, "Views must be of rank 2");
 	if (A.extent(0) != B.extent(0) || A.extent(1) != B.extent(1)) {
@@ -143,14 +354,15 @@ template <class AMatrixType, class BMatrixType> auto matrix_are_equal(AMatrixTyp
 		return false;
 	}
 
-	constexpr double EPS = 1e-10;
-	for (int i = 0; i < int(A.extent(0)); i++) {
-		for (int j = 0; j < int(A.extent(1)); j++) {
-			if (std::abs(A(i, j) - B(i, j)) > EPS) {
-				fmt::print("Mismatch at ({}, {}): {} != {}\n", i, j, A(i, j), B(i, j));
-				return false;
-			}
-		}
+	auto comparison = matrix_compare(A, B);
+	if (comparison.mismatches != 0) {
+		fmt::print("{} mismatches out of {} elements: max absolute error {}, max relative error {}, max ULP distance {}\n",
+			   comparison.mismatches,
+			   A.extent(0) * A.extent(1),
+			   comparison.max_abs_error,
+			   comparison.max_rel_error,
+			   comparison.max_ulp_distance);
+		return false;
 	}
 	return true;
 }
@@ -0,0 +1,78 @@
+/**
+ * @file src/matrix_product_cblas.hpp
+ * @brief Matrix product through an external CBLAS (OpenBLAS, BLIS, ...), as a baseline for the in-house kernels.
+ * Only available when CMake found a CBLAS, which defines TOP_HAVE_CBLAS.
+ */
+
+#ifndef TOP_MATRIX_PRODUCT_CBLAS_HPP
+#define TOP_MATRIX_PRODUCT_CBLAS_HPP
+
+#ifdef TOP_HAVE_CBLAS
+
+#	include "matrix_product.hpp"
+
+#	include <Kokkos_Core.hpp>
+#	include <algorithm>
+#	include <cassert>
+#	include <cblas.h>
+#	include <cstdlib>
+#	include <fmt/core.h>
+
+/**
+ * @brief Storage of a View as seen by a row-major CBLAS call
+ */
+struct CblasOperand {
+	CBLAS_TRANSPOSE transpose;
+	int ld;
+};
+
+/**
+ * @brief A row-major View is passed as is, and a column-major View as the transpose of its row-major transpose.
+ * Views with no unit stride cannot be passed to CBLAS.
+ */
+template <class MatrixType> auto cblas_operand(MatrixType const& M) -> CblasOperand {
+	if (M.stride(1) == 1) {
+		return CblasOperand{CblasNoTrans, int(std::max<size_t>(M.stride(0), std::max<size_t>(M.extent(1), 1)))};
+	}
+	if (M.stride(0) == 1) {
+		return CblasOperand{CblasTrans, int(std::max<size_t>(M.stride(1), std::max<size_t>(M.extent(0), 1)))};
+	}
+	fmt::println(stderr, "matrix_product_cblas: {} has no unit stride", M.label());
+	std::abort();
+}
+
+/**
+ * @brief Same product as matrix_product_reference, C(i, j) *= beta + alpha * sum_k A(i, k) * B(k, j).
+ * This is not a dgemm, so alpha * A * B goes through cblas_dgemm into a temporary, which is then applied to C.
+ */
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_cblas(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C) -> void {
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
+	assert(A.extent(1) == B.extent(0));
+	assert(A.extent(0) == C.extent(0));
+	assert(B.extent(1) == C.extent(1));
+
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	RightMatrix AB(Kokkos::view_alloc(Kokkos::WithoutInitializing, "AB"), m, n);
+	auto a = cblas_operand(A);
+	auto b = cblas_operand(B);
+	Kokkos::fence("dgemm_cblas: wait for A and B");
+	cblas_dgemm(CblasRowMajor, a.transpose, b.transpose, m, n, k, alpha, A.data(), a.ld, B.data(), b.ld, 0.0, AB.data(), std::max(n, 1));
+
+	// Label of the kernel in Kokkos Tools, with the layouts of A, B and C
+	auto label = fmt::format(
+	    "dgemm_cblas_scale_A{}_B{}_C{}", layout_letter<AMatrixType>(), layout_letter<BMatrixType>(), layout_letter<CMatrixType>());
+	Kokkos::parallel_for(
+	    label, C.extent(0), KOKKOS_LAMBDA(int i) {
+		    for (int j = 0; j < int(C.extent(1)); ++j) {
+			    C(i, j) *= beta + AB(i, j);
+		    }
+	    });
+}
+
+#endif
+
+#endif
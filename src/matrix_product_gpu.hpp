@@ -0,0 +1,751 @@
+/**
+ * @file src/matrix_product_gpu.hpp
+ * @brief Matrix product on the GPU through culkan, streamed by panels of rows of A and C.
+ * The device only holds B and a few panels, so products larger than the device memory run, and the host fills a panel while
+ * the device computes the previous one. Host matrices can also be imported as bindings, to run without copies.
+ * matrix_product_gpu() takes the same arguments as the CPU kernels, and reuses the pipelines and buffers of the shapes it has run.
+ */
+
+#ifndef TOP_MATRIX_PRODUCT_GPU_HPP
+#define TOP_MATRIX_PRODUCT_GPU_HPP
+
+#include "culkan.h"
+#include "matrix_product.hpp"
+#include "shaders.hpp"
+
+#include <Kokkos_Core.hpp>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/core.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief Host matrix whose storage can be imported as a culkan binding by culkanImportBinding(), so that the shaders read and write
+ * it in place. The storage is aligned on the import alignment of the device and padded to a multiple of it, which Kokkos
+ * allocations are not. view is an unmanaged View of the storage, valid as long as the ImportableMatrix.
+ */
+template <class MatrixType> class ImportableMatrix {
+      public:
+	/**
+	 * @param alignment culkanGetHostImportAlignment() of the context, or 0 if it cannot import, then the storage is only aligned
+	 * on cache lines
+	 */
+	ImportableMatrix(int rows, int cols, size_t alignment) {
+		alignment    = std::max<size_t>(alignment, 64);
+		size_t bytes = (size_t(rows) * size_t(cols) * sizeof(double) + alignment - 1) / alignment * alignment;
+		storage.reset(static_cast<double*>(std::aligned_alloc(alignment, std::max(bytes, alignment))));
+		view = MatrixType(storage.get(), rows, cols);
+	}
+
+	MatrixType view;
+
+      private:
+	struct Free {
+		auto operator()(double* data) const -> void {
+			std::free(data);
+		}
+	};
+	std::unique_ptr<double, Free> storage;
+};
+
+// Some drivers address a binding with 32-bit byte offsets, whatever maxStorageBufferRange says
+constexpr size_t GPU_MAX_BINDING_BYTES = size_t(1) << 32;
+
+/**
+ * @brief Limits of a device on the storage bindings of the GPU products
+ */
+struct GpuMemoryLimits {
+	size_t binding; // Largest binding, maxStorageBufferRange
+	size_t heap;	// Memory heap of the bindings, which holds all of them
+};
+
+/**
+ * @brief Gets the limits of the device of a context, see culkanGetMaxBindingSize() and culkanGetBindingHeapSize()
+ */
+inline auto gpu_memory_limits(CulkanContext* context) -> GpuMemoryLimits {
+	return {.binding = culkanGetMaxBindingSize(context, STORAGE_BUFFER), .heap = culkanGetBindingHeapSize(context, STORAGE_BUFFER)};
+}
+
+/**
+ * @brief Rows of the panels of GpuStreamedProduct such that B and the panels of A and C of every slot fit in budget bytes and
+ * in the heap of the device, and each binding in its largest binding.
+ * A multiple of the tiles of operation_tiled.comp, and no more tiles than m needs.
+ * @return the rows, or nothing if the memory cannot hold B and a panel of one tile per slot, or B is larger than a binding,
+ * since B is not tiled
+ */
+inline auto streamed_panel_rows(int m, int n, int k, size_t budget, GpuMemoryLimits const& limits, int slots = 2) -> std::optional<int> {
+	constexpr size_t TILE = OPERATION_TILED_TILE;
+	slots		      = std::max(slots, 1);
+	budget		      = std::min(budget, limits.heap);
+	size_t b_bytes	      = size_t(k) * size_t(n) * sizeof(double);
+	size_t row_bytes      = size_t(k + n) * sizeof(double) * size_t(slots);
+	size_t rows	      = budget > b_bytes ? (budget - b_bytes) / row_bytes / TILE * TILE : 0;
+	size_t m_tiles	      = (size_t(std::max(m, 1)) + TILE - 1) / TILE * TILE;
+	// The panels of A and C of all the slots are in one binding each
+	size_t binding_rows = limits.binding / (size_t(std::max(k, n)) * sizeof(double) * size_t(slots)) / TILE * TILE;
+	rows		    = std::min(rows, binding_rows);
+	if (b_bytes > limits.binding || rows < TILE) {
+		return std::nullopt;
+	}
+	return int(std::min(rows, m_tiles));
+}
+
+/**
+ * @brief Product of an m x n x k shape on the GPU, by panels of panel_rows rows of A and C.
+ * B stays on the device, and each of the slots holds a panel of A and C in a region of the bindings of a single
+ * operation_tiled.comp instance, at the row_offset of its push constants. Each slot records its panel in three sequences,
+ * the upload of A and C, the dispatch and the download of C, submitted by culkanSubmitSequenceAfter() after each other: they
+ * are ordered by waits on the timeline semaphore of the context instead of barriers, so the upload of a panel waits for
+ * nothing on the device and overlaps the dispatch of the previous one. The host only waits for the panel of a slot before
+ * filling it again, so that it fills the next slots while the device computes.
+ * On a single queue, the signal of a submission still waits for the commands submitted before it, so a dispatch starts
+ * after the download of the previous panel: only the uploads overlap the dispatches.
+ * With overlap false, the upload of a panel also waits for the download of the previous one, as a barrier would, to
+ * measure what the overlap saves.
+ * The pipeline and the buffers are created once, for all the products of the shape, on a context of its own unless one is
+ * given, such as the one of GpuProductCache, which falls back to it for the products too large for a plan.
+ */
+class GpuStreamedProduct {
+      public:
+	GpuStreamedProduct(int m, int n, int k, int panel_rows, int slots = 2, bool overlap = true, CulkanContext* shared_context = nullptr)
+	    : m(m), n(n), k(k), panel_rows(std::clamp(panel_rows, 1, std::max(m, 1))), slots(std::max(slots, 1)), overlap(overlap),
+	      owns_context(shared_context == nullptr) {
+		size_t slot_rows	      = size_t(this->slots) * size_t(this->panel_rows);
+		bindings[OPERATION_BINDING_A] = {.size = slot_rows * k * sizeof(double), .type = STORAGE_BUFFER};
+		bindings[OPERATION_BINDING_B] = {.size = size_t(k) * n * sizeof(double), .type = STORAGE_BUFFER};
+		bindings[OPERATION_BINDING_C] = {.size = slot_rows * n * sizeof(double), .type = STORAGE_BUFFER};
+
+		// k is known when the pipeline is created (OPERATION_TILED_K_SIZE, then OPERATION_TILED_TILE_K)
+		constants[OPERATION_TILED_K_SIZE] = uint32_t(k);
+		constants[OPERATION_TILED_TILE_K] = 8;
+		layout = CulkanLayout{
+		    .bindingCount		 = 3,
+		    .bindings			 = bindings,
+		    .pushConstantSize		 = sizeof(OperationScalars),
+		    .specializationConstants	 = constants,
+		    .specializationConstantCount = 2,
+		    .requiredSubgroupSize	 = 0,
+		};
+
+		context = owns_context ? culkanCreateContext() : shared_context;
+		culkan	= culkanInitWithContext(
+		    context, &layout, OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV), CulkanInvocations{16, 16, 1});
+		culkanSetup(culkan);
+		// Rows past the end of a shorter last panel are skipped by the shader
+		culkanSetGroupCount(culkan, operation_tiled_group_count(uint32_t(this->panel_rows), uint32_t(n)));
+		for (int slot = 0; slot < this->slots; slot++) {
+			sequences.push_back({culkanCreateSequence(context), culkanCreateSequence(context), culkanCreateSequence(context)});
+		}
+		slot_panels.assign(size_t(this->slots), -1);
+	}
+
+	GpuStreamedProduct(GpuStreamedProduct const&)			 = delete;
+	auto operator=(GpuStreamedProduct const&) -> GpuStreamedProduct& = delete;
+
+	~GpuStreamedProduct() {
+		for (auto const& slot : sequences) {
+			culkanDestroySequence(slot.upload);
+			culkanDestroySequence(slot.compute);
+			culkanDestroySequence(slot.download);
+		}
+		culkanDestroy(culkan);
+		if (owns_context) {
+			culkanDestroyContext(context);
+		}
+	}
+
+	/**
+	 * @brief Number of panels of a product
+	 */
+	auto panel_count() const -> int {
+		return (m + panel_rows - 1) / panel_rows;
+	}
+
+	/**
+	 * @brief Rows of a panel, the last one may be shorter
+	 */
+	auto rows() const -> int {
+		return panel_rows;
+	}
+
+	/**
+	 * @brief Bytes of device memory of the bindings, B and a panel of A and C per slot
+	 */
+	auto device_bytes() const -> size_t {
+		return bindings[OPERATION_BINDING_A].size + bindings[OPERATION_BINDING_B].size + bindings[OPERATION_BINDING_C].size;
+	}
+
+	/**
+	 * @brief Device times of the uploads, dispatches and downloads of the last run, summed over its panels.
+	 * A timestamp waits for the commands submitted before it, so they are exact only without overlap.
+	 * @return the times, or nothing if the queue cannot write timestamps
+	 */
+	auto stage_times() const -> std::optional<CulkanStageTimes> {
+		if (!timed) {
+			return std::nullopt;
+		}
+		return times;
+	}
+
+	/**
+	 * @brief Same product as matrix_product_reference, on contiguous matrices of the shape of the instance
+	 */
+	auto run(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix& C) -> void {
+		assert(int(A.extent(0)) == m && int(A.extent(1)) == k);
+		assert(int(B.extent(0)) == k && int(B.extent(1)) == n);
+		assert(int(C.extent(0)) == m && int(C.extent(1)) == n);
+		assert(A.span_is_contiguous() && B.span_is_contiguous() && C.span_is_contiguous());
+		Kokkos::fence("matrix_product_gpu_streamed: wait for A, B and C");
+
+		// Used by every panel, uploaded once
+		culkanWriteBinding(culkan, OPERATION_BINDING_B, B.data());
+		times = {};
+		timed = true;
+
+		for (int panel = 0; panel < panel_count(); panel++) {
+			int slot = panel % slots;
+			read_back(slot, C);
+
+			// Offsets and sizes of the panel in the bindings, in bytes
+			int first	= panel * panel_rows;
+			int rows	= std::min(panel_rows, m - first);
+			size_t a_offset = size_t(slot) * panel_rows * k * sizeof(double);
+			size_t c_offset = size_t(slot) * panel_rows * n * sizeof(double);
+			size_t a_size	= size_t(rows) * k * sizeof(double);
+			size_t c_size	= size_t(rows) * n * sizeof(double);
+			std::memcpy(binding_bytes(OPERATION_BINDING_A) + a_offset, A.data() + size_t(first) * k, a_size);
+			std::memcpy(binding_bytes(OPERATION_BINDING_C) + c_offset, C.data() + size_t(first) * n, c_size);
+
+			// Recorded with the push constants of the panel, the instance itself is never run
+			OperationScalars scalars = {
+			    .m		= uint32_t(rows),
+			    .n		= uint32_t(n),
+			    .k		= uint32_t(k),
+			    .row_offset = uint32_t(slot * panel_rows),
+			    .alpha	= alpha,
+			    .beta	= beta,
+			};
+			culkanSetPushConstants(culkan, &scalars);
+
+			// Download of the previous panel, already complete for the first one
+			SlotSequences const& sequence = sequences[size_t(slot)];
+			int previous_slot	      = (panel + slots - 1) % slots;
+			CulkanSubmission previous     = culkanGetSequenceSubmission(sequences[size_t(previous_slot)].download);
+
+			culkanBeginSequence(sequence.upload);
+			culkanSequenceUpload(sequence.upload, culkan, OPERATION_BINDING_A, a_offset, a_size);
+			culkanSequenceUpload(sequence.upload, culkan, OPERATION_BINDING_C, c_offset, c_size);
+			CulkanSubmission uploaded = culkanSubmitSequenceAfter(sequence.upload, &previous, overlap ? 0 : 1);
+
+			culkanBeginSequence(sequence.compute);
+			culkanSequenceDispatch(sequence.compute, culkan);
+			CulkanSubmission computed = culkanSubmitSequenceAfter(sequence.compute, &uploaded, 1);
+
+			culkanBeginSequence(sequence.download);
+			culkanSequenceDownload(sequence.download, culkan, OPERATION_BINDING_C, c_offset, c_size);
+			culkanSubmitSequenceAfter(sequence.download, &computed, 1);
+			slot_panels[size_t(slot)] = panel;
+		}
+
+		// The last panels, in the order they were submitted
+		for (int panel = std::max(0, panel_count() - slots); panel < panel_count(); panel++) {
+			read_back(panel % slots, C);
+		}
+	}
+
+      private:
+	auto binding_bytes(uint32_t binding) -> char* {
+		return static_cast<char*>(culkanGetBindingPointer(culkan, binding));
+	}
+
+	/**
+	 * @brief Waits for the panel of a slot and copies it to C, so that the slot can take the next one
+	 */
+	auto read_back(int slot, RightMatrix& C) -> void {
+		int panel = slot_panels[size_t(slot)];
+		if (panel < 0) {
+			return;
+		}
+		// The download waited for the upload and the dispatch of the slot
+		SlotSequences const& sequence = sequences[size_t(slot)];
+		culkanWait(culkanGetSequenceSubmission(sequence.download));
+		culkanInvalidateMappedBinding(culkan, OPERATION_BINDING_C);
+		for (CulkanSequence* stage : {sequence.upload, sequence.compute, sequence.download}) {
+			CulkanStageTimes stage_times;
+			if (!culkanGetSequenceTimes(stage, &stage_times)) {
+				timed = false;
+			}
+			for (int i = 0; i < CULKAN_STAGE_COUNT; i++) {
+				times.seconds[i] += stage_times.seconds[i];
+				times.commands[i] += stage_times.commands[i];
+			}
+		}
+
+		int first = panel * panel_rows;
+		int rows  = std::min(panel_rows, m - first);
+		std::memcpy(C.data() + size_t(first) * n,
+			    binding_bytes(OPERATION_BINDING_C) + size_t(slot) * panel_rows * n * sizeof(double),
+			    size_t(rows) * n * sizeof(double));
+		slot_panels[size_t(slot)] = -1;
+	}
+
+	int m;
+	int n;
+	int k;
+	int panel_rows;
+	int slots;
+	bool overlap;
+	bool owns_context; // Whether the context was created by the instance, rather than given
+
+	// Sequences of a slot, submitted one after the other
+	struct SlotSequences {
+		CulkanSequence* upload;
+		CulkanSequence* compute;
+		CulkanSequence* download;
+	};
+
+	// Referenced by the layout, itself referenced by the instance
+	CulkanBinding bindings[3];
+	uint32_t constants[2];
+	CulkanLayout layout;
+
+	CulkanContext* context;
+	Culkan* culkan;
+	std::vector<SlotSequences> sequences;
+	std::vector<int> slot_panels; // Panel held by each slot until it is read back, -1 if none
+	CulkanStageTimes times = {};  // Summed over the panels of the last run
+	bool timed	       = false;
+};
+
+/**
+ * @brief Copies a matrix into another of the same shape, in any layouts, converting its elements to the type of dst
+ */
+template <class DstMatrixType, class SrcMatrixType> auto copy_matrix(DstMatrixType const& dst, SrcMatrixType const& src) -> void {
+	using Scalar = typename DstMatrixType::non_const_value_type;
+	if constexpr (std::is_same_v<Scalar, typename SrcMatrixType::non_const_value_type>) {
+		Kokkos::deep_copy(dst, src);
+	}
+	else {
+		Kokkos::parallel_for(
+		    "copy_matrix", dst.extent(0), KOKKOS_LAMBDA(int i) {
+			    for (int j = 0; j < int(dst.extent(1)); ++j) {
+				    dst(i, j) = Scalar(src(i, j));
+			    }
+		    });
+	}
+}
+
+/**
+ * @brief Pipeline and buffers of an m x n x k product with a variant of the shader, for matrix_product_gpu().
+ * A single instance, with k specialized, whose bindings hold the whole of A, B and C, in floats for the fp32 variant.
+ */
+class GpuProductPlan {
+      public:
+	GpuProductPlan(CulkanContext* context, int m, int n, int k, OperationVariant variant) : m(m), n(n), k(k), variant(variant) {
+		CulkanDeviceFeatures features = culkanGetDeviceFeatures(context);
+		if (!operation_variant_supported(features, variant)) {
+			auto name = operation_variant_info(variant).name;
+			fmt::println(stderr, "matrix_product_gpu: the device cannot run the {} variant", name);
+			std::abort();
+		}
+
+		size_t element		      = variant == OperationVariant::Fp32 ? sizeof(float) : sizeof(double);
+		bindings[OPERATION_BINDING_A] = {.size = size_t(m) * k * element, .type = STORAGE_BUFFER};
+		bindings[OPERATION_BINDING_B] = {.size = size_t(k) * n * element, .type = STORAGE_BUFFER};
+		bindings[OPERATION_BINDING_C] = {.size = size_t(m) * n * element, .type = STORAGE_BUFFER};
+
+		CulkanInvocations invocations = {16, 16, 1};
+		CulkanGroupCount group_count  = operation_tiled_group_count(uint32_t(m), uint32_t(n));
+		if (variant == OperationVariant::Subgroup) {
+			uint32_t lanes			     = features.subgroupSize;
+			constants[OPERATION_SUBGROUP_SIZE]   = lanes;
+			constants[OPERATION_SUBGROUP_K_SIZE] = uint32_t(k);
+			invocations			     = {uint16_t(lanes), 1, 1};
+			group_count			     = operation_subgroup_group_count(uint32_t(m), uint32_t(n), lanes);
+		}
+		else {
+			constants[OPERATION_TILED_K_SIZE] = uint32_t(k);
+			constants[OPERATION_TILED_TILE_K] = 8;
+		}
+		uint32_t scalars_size = variant == OperationVariant::Fp32 ? sizeof(OperationScalarsFp32) : sizeof(OperationScalars);
+
+		layout = CulkanLayout{
+		    .bindingCount		 = 3,
+		    .bindings			 = bindings,
+		    .pushConstantSize		 = scalars_size,
+		    .specializationConstants	 = constants,
+		    .specializationConstantCount = 2,
+		    .requiredSubgroupSize	 = variant == OperationVariant::Subgroup ? features.subgroupSize : 0,
+		};
+
+		auto const& info = operation_variant_info(variant);
+		culkan		 = culkanInitWithContext(context, &layout, info.spirv, info.spirv_size, invocations);
+		culkanSetup(culkan);
+		culkanSetGroupCount(culkan, group_count);
+	}
+
+	GpuProductPlan(GpuProductPlan const&)			 = delete;
+	auto operator=(GpuProductPlan const&) -> GpuProductPlan& = delete;
+
+	~GpuProductPlan() {
+		culkanDestroy(culkan);
+	}
+
+	/**
+	 * @brief Same product as matrix_product_reference, on matrices of the shape of the plan in any layout.
+	 * They are copied to and from the mapped memory of the bindings, in the layouts of the shader: deep_copy is a memcpy
+	 * when a matrix already has it, and transposes it otherwise. The fp32 variant rounds them to floats on the way.
+	 */
+	template <class AMatrixType, class BMatrixType, class CMatrixType>
+	auto run(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C) -> void {
+		assert(int(A.extent(0)) == m && int(A.extent(1)) == k);
+		assert(int(B.extent(0)) == k && int(B.extent(1)) == n);
+		assert(int(C.extent(0)) == m && int(C.extent(1)) == n);
+
+		if (variant == OperationVariant::Fp32) {
+			OperationScalarsFp32 scalars = {
+			    .m		= uint32_t(m),
+			    .n		= uint32_t(n),
+			    .k		= uint32_t(k),
+			    .row_offset = 0,
+			    .alpha	= float(alpha),
+			    .beta	= float(beta),
+			};
+			run_with<float>(scalars, A, B, C);
+		}
+		else {
+			OperationScalars scalars = {
+			    .m		= uint32_t(m),
+			    .n		= uint32_t(n),
+			    .k		= uint32_t(k),
+			    .row_offset = 0,
+			    .alpha	= alpha,
+			    .beta	= beta,
+			};
+			run_with<double>(scalars, A, B, C);
+		}
+	}
+
+	/**
+	 * @brief Bytes of the bindings of the plan, in device memory
+	 */
+	auto bytes() const -> size_t {
+		return bindings[OPERATION_BINDING_A].size + bindings[OPERATION_BINDING_B].size + bindings[OPERATION_BINDING_C].size;
+	}
+
+      private:
+	template <class Scalar, class Scalars, class AMatrixType, class BMatrixType, class CMatrixType>
+	auto run_with(Scalars const& scalars, AMatrixType const& A, BMatrixType const& B, CMatrixType& C) -> void {
+		Kokkos::View<Scalar**, Kokkos::LayoutRight> a_binding(binding_data<Scalar>(OPERATION_BINDING_A), m, k);
+		Kokkos::View<Scalar**, Kokkos::LayoutLeft> b_binding(binding_data<Scalar>(OPERATION_BINDING_B), k, n);
+		Kokkos::View<Scalar**, Kokkos::LayoutRight> c_binding(binding_data<Scalar>(OPERATION_BINDING_C), m, n);
+		copy_matrix(a_binding, A);
+		copy_matrix(b_binding, B);
+		copy_matrix(c_binding, C);
+		Kokkos::fence("matrix_product_gpu: wait for the bindings");
+		culkanFlushBinding(culkan, OPERATION_BINDING_A);
+		culkanFlushBinding(culkan, OPERATION_BINDING_B);
+		culkanFlushBinding(culkan, OPERATION_BINDING_C);
+
+		culkanSetPushConstants(culkan, &scalars);
+		culkanRun(culkan);
+
+		culkanInvalidateBinding(culkan, OPERATION_BINDING_C);
+		copy_matrix(C, c_binding);
+	}
+
+	template <class Scalar> auto binding_data(uint32_t binding) -> Scalar* {
+		return static_cast<Scalar*>(culkanGetBindingPointer(culkan, binding));
+	}
+
+	int m;
+	int n;
+	int k;
+	OperationVariant variant;
+
+	// Referenced by the layout, itself referenced by the instance
+	CulkanBinding bindings[3];
+	uint32_t constants[2];
+	CulkanLayout layout;
+
+	Culkan* culkan;
+};
+
+/**
+ * @brief Plans of matrix_product_gpu(), by shape and variant, on a context created with the first one.
+ * Each plan holds its buffers, so the least recently used plans are destroyed once their bindings take more than capacity bytes.
+ * The buffers of an evicted plan go back to the memory pool of the context, for the next plans: the blocks of the pool are
+ * only freed by clear(), except those of buffers larger than a block (CULKAN_MEMORY_BLOCK_SIZE), freed with their buffer.
+ */
+class GpuProductCache {
+      public:
+	explicit GpuProductCache(size_t capacity = size_t(1) << 30) : capacity(capacity) {}
+
+	GpuProductCache(GpuProductCache const&)			   = delete;
+	auto operator=(GpuProductCache const&) -> GpuProductCache& = delete;
+
+	~GpuProductCache() {
+		clear();
+	}
+
+	/**
+	 * @brief Plan of a shape and variant, created if it is not in the cache, after evicting the least recently used ones until
+	 * its bindings fit in the capacity along with those of the others. A plan larger than the capacity is kept alone.
+	 */
+	auto plan(int m, int n, int k, OperationVariant variant) -> GpuProductPlan& {
+		uses++;
+		auto found = plans.find({m, n, k, int(variant)});
+		if (found == plans.end()) {
+			if (!fits(m, n, k, variant)) {
+				auto shape = fmt::format("{}x{}x{}", m, n, k);
+				fmt::println(stderr, "matrix_product_gpu: the bindings of a {} plan exceed the device limits", shape);
+				std::abort();
+			}
+			// The plan takes the memory of the streamed product
+			streamed_product.reset();
+			size_t needed = plan_bytes(m, n, k, variant);
+			auto older    = [](auto const& lhs, auto const& rhs) { return lhs.second.last_use < rhs.second.last_use; };
+			while (!plans.empty() && held + needed > capacity) {
+				auto oldest = std::min_element(plans.begin(), plans.end(), older);
+				held -= oldest->second.plan->bytes();
+				plans.erase(oldest);
+			}
+			auto plan = std::make_unique<GpuProductPlan>(get_context(), m, n, k, variant);
+			held += plan->bytes();
+			found = plans.emplace(Key{m, n, k, int(variant)}, Entry{std::move(plan), 0}).first;
+		}
+		found->second.last_use = uses;
+		return *found->second.plan;
+	}
+
+	/**
+	 * @brief Whether the whole matrices of a plan fit in the bindings of the device: each of them in its largest binding and
+	 * GPU_MAX_BINDING_BYTES, and all of them in the memory heap of the bindings
+	 */
+	auto fits(int m, int n, int k, OperationVariant variant) -> bool {
+		auto limits    = gpu_memory_limits(get_context());
+		size_t element = variant == OperationVariant::Fp32 ? sizeof(float) : sizeof(double);
+		size_t largest = std::max({size_t(m) * k, size_t(k) * n, size_t(m) * n}) * element;
+		return largest <= std::min(limits.binding, GPU_MAX_BINDING_BYTES) && plan_bytes(m, n, k, variant) <= limits.heap;
+	}
+
+	/**
+	 * @brief Streamed product of a shape, for matrix_product_gpu() when its plan does not fit the device, on the context of the
+	 * plans. Only the last shape is kept, and the plans are destroyed first, so that it takes their memory: the panels fill half
+	 * of the heap of the bindings.
+	 * @return the product, or nullptr if the device cannot hold B and a tile of rows per slot
+	 */
+	auto streamed(int m, int n, int k) -> GpuStreamedProduct* {
+		Key key = {m, n, k, int(OperationVariant::Tiled)};
+		if (streamed_product != nullptr && streamed_key == key) {
+			return streamed_product.get();
+		}
+		streamed_product.reset();
+		plans.clear();
+		held = 0;
+
+		auto limits = gpu_memory_limits(get_context());
+		auto rows   = streamed_panel_rows(m, n, k, limits.heap / 2, limits);
+		if (!rows) {
+			return nullptr;
+		}
+		streamed_product = std::make_unique<GpuStreamedProduct>(m, n, k, *rows, 2, true, get_context());
+		streamed_key	 = key;
+		return streamed_product.get();
+	}
+
+	/**
+	 * @brief Variant of matrix_product_gpu() when none is given, chosen by the first call for the context: TOP_GPU_VARIANT
+	 * (tiled, subgroup, mixed or fp32) if the device runs it, with a warning if it does not or the name is unknown, otherwise
+	 * the tiled variant, or the subgroup one if the device runs it and it is faster on a probe product
+	 */
+	auto default_variant() -> OperationVariant {
+		if (!chosen_variant.has_value()) {
+			chosen_variant = choose_variant();
+		}
+		return *chosen_variant;
+	}
+
+	/**
+	 * @brief Number of plans in the cache
+	 */
+	auto size() const -> size_t {
+		return plans.size();
+	}
+
+	/**
+	 * @brief Bytes of the bindings of the plans in the cache, at most the capacity unless a single plan is larger
+	 */
+	auto bytes() const -> size_t {
+		return held;
+	}
+
+	/**
+	 * @brief Destroys the plans and the context, before Kokkos::finalize() or to free the device memory
+	 */
+	auto clear() -> void {
+		streamed_product.reset();
+		plans.clear();
+		held = 0;
+		chosen_variant.reset();
+		if (context != nullptr) {
+			culkanDestroyContext(context);
+			context = nullptr;
+		}
+	}
+
+	/**
+	 * @brief Context of the plans, created on the first call
+	 */
+	auto get_context() -> CulkanContext* {
+		if (context == nullptr) {
+			context = culkanCreateContext();
+		}
+		return context;
+	}
+
+      private:
+	using Key = std::array<int, 4>; // m, n, k, variant
+
+	static auto plan_bytes(int m, int n, int k, OperationVariant variant) -> size_t {
+		size_t element = variant == OperationVariant::Fp32 ? sizeof(float) : sizeof(double);
+		return (size_t(m) * k + size_t(k) * n + size_t(m) * n) * element;
+	}
+
+	// Shape and runs of the products timed by probe_time()
+	static constexpr int PROBE_SIZE = 512;
+	static constexpr int PROBE_RUNS = 3;
+
+	auto choose_variant() -> OperationVariant {
+		CulkanDeviceFeatures features = culkanGetDeviceFeatures(get_context());
+		char const* name	      = std::getenv("TOP_GPU_VARIANT");
+		if (name != nullptr && *name != '\0') {
+			auto variant = operation_variant_from_name(name);
+			if (!variant.has_value()) {
+				fmt::println(stderr, "matrix_product_gpu: TOP_GPU_VARIANT {} is not tiled, subgroup, mixed or fp32", name);
+			}
+			else if (!operation_variant_supported(features, *variant)) {
+				fmt::println(stderr, "matrix_product_gpu: the device cannot run the {} variant of TOP_GPU_VARIANT", name);
+			}
+			else {
+				return *variant;
+			}
+		}
+
+		auto variant = best_operation_variant(features, GpuPrecision::Double);
+		if (variant == OperationVariant::Tiled && operation_variant_supported(features, OperationVariant::Subgroup) &&
+		    probe_time(OperationVariant::Subgroup) < probe_time(OperationVariant::Tiled)) {
+			return OperationVariant::Subgroup;
+		}
+		return variant;
+	}
+
+	/**
+	 * @brief Best time of a few PROBE_SIZE cube products with a variant, on a plan of its own that is not kept.
+	 * The copies of the matrices are the same for every variant, so the times only differ by the dispatch.
+	 */
+	auto probe_time(OperationVariant variant) -> double {
+		Kokkos::View<double**, Kokkos::LayoutRight> A("probe_A", PROBE_SIZE, PROBE_SIZE);
+		Kokkos::View<double**, Kokkos::LayoutLeft> B("probe_B", PROBE_SIZE, PROBE_SIZE);
+		Kokkos::View<double**, Kokkos::LayoutRight> C("probe_C", PROBE_SIZE, PROBE_SIZE);
+		GpuProductPlan plan(get_context(), PROBE_SIZE, PROBE_SIZE, PROBE_SIZE, variant);
+
+		// The first run waits for the driver to finish the pipeline on some devices
+		plan.run(1.0, A, B, 1.0, C);
+		double best = std::numeric_limits<double>::infinity();
+		for (int run = 0; run < PROBE_RUNS; ++run) {
+			Kokkos::Timer timer;
+			plan.run(1.0, A, B, 1.0, C);
+			best = std::min(best, timer.seconds());
+		}
+		return best;
+	}
+
+	struct Entry {
+		std::unique_ptr<GpuProductPlan> plan;
+		uint64_t last_use;
+	};
+
+	// In bytes of bindings, and the bytes of the bindings of the plans in the cache
+	size_t capacity;
+	size_t held	       = 0;
+	uint64_t uses	       = 0;
+	CulkanContext* context = nullptr;
+	std::map<Key, Entry> plans;
+	std::optional<OperationVariant> chosen_variant; // By the first default_variant() of the context
+	std::unique_ptr<GpuStreamedProduct> streamed_product;
+	Key streamed_key = {};
+};
+
+/**
+ * @brief Cache of the plans of matrix_product_gpu(), shared by the whole program
+ */
+inline auto gpu_product_cache() -> GpuProductCache& {
+	static GpuProductCache cache;
+	return cache;
+}
+
+/**
+ * @brief Same product as matrix_product_reference, C(i, j) *= beta + alpha * sum_k A(i, k) * B(k, j), on the GPU with a variant
+ * of the shader. The first call with a shape and variant creates its pipeline and buffers, and the next ones only copy the
+ * matrices and run it.
+ * The products whose matrices do not fit in the bindings of the device (GpuProductCache::fits()) are streamed by panels with
+ * the tiled variant in doubles, through copies of the matrices in the layouts of GpuStreamedProduct.
+ */
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_gpu(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C, OperationVariant variant)
+    -> void {
+	static_assert(AMatrixType::rank() == 2 && BMatrixType::rank() == 2 && CMatrixType::rank() == 2, "Views must be of rank 2");
+	assert(A.extent(1) == B.extent(0));
+	assert(A.extent(0) == C.extent(0));
+	assert(B.extent(1) == C.extent(1));
+
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	// Bindings cannot be empty, and there is at most a scaling of C to compute
+	if (m == 0 || n == 0 || k == 0) {
+		matrix_product_reference(alpha, A, B, beta, C);
+		return;
+	}
+
+	auto& cache = gpu_product_cache();
+	if (cache.fits(m, n, k, variant)) {
+		cache.plan(m, n, k, variant).run(alpha, A, B, beta, C);
+		return;
+	}
+	GpuStreamedProduct* streamed = cache.streamed(m, n, k);
+	if (streamed == nullptr) {
+		auto shape = fmt::format("{}x{}x{}", m, n, k);
+		fmt::println(stderr, "matrix_product_gpu: B of a {} product does not fit in the memory or a binding of the device", shape);
+		std::abort();
+	}
+	auto A_streamed = RightMatrix("A_streamed", m, k);
+	auto B_streamed = LeftMatrix("B_streamed", k, n);
+	auto C_streamed = RightMatrix("C_streamed", m, n);
+	copy_matrix(A_streamed, A);
+	copy_matrix(B_streamed, B);
+	copy_matrix(C_streamed, C);
+	streamed->run(alpha, A_streamed, B_streamed, beta, C_streamed);
+	copy_matrix(C, C_streamed);
+}
+
+/**
+ * @brief matrix_product_gpu() with the variant that the device runs best in double precision, see GpuProductCache::default_variant()
+ */
+template <class AMatrixType, class BMatrixType, class CMatrixType>
+auto matrix_product_gpu(double alpha, AMatrixType const& A, BMatrixType const& B, double beta, CMatrixType& C) -> void {
+	matrix_product_gpu(alpha, A, B, beta, C, gpu_product_cache().default_variant());
+}
+
+#endif
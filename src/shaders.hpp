@@ -0,0 +1,212 @@
+/**
+ * @file src/shaders.hpp
+ * @brief SPIR-V of the compute shaders, compiled by CMake at build time and embedded in the binary.
+ * Pass them to culkanInitFromMemory(), so that the executables neither run glslc nor depend on the working directory.
+ */
+
+#ifndef TOP_SHADERS_HPP
+#define TOP_SHADERS_HPP
+
+#include "culkan.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string_view>
+
+/**
+ * @brief Push constant block of operation.comp and operation_tiled.comp, with the layout of the shaders
+ */
+struct OperationScalars {
+	uint32_t m;
+	uint32_t n;
+	uint32_t k;
+	uint32_t row_offset; // First row of A and C in their bindings, which can hold several panels. Also aligns alpha on 8 bytes.
+	double alpha;
+	double beta;
+};
+static_assert(sizeof(OperationScalars) == 32, "OperationScalars must match the push constant block of the shaders");
+
+/**
+ * @brief Push constant block of operation_tiled.comp compiled with floats, OperationScalars with alpha and beta in single precision
+ */
+struct OperationScalarsFp32 {
+	uint32_t m;
+	uint32_t n;
+	uint32_t k;
+	uint32_t row_offset;
+	float alpha;
+	float beta;
+};
+static_assert(sizeof(OperationScalarsFp32) == 24, "OperationScalarsFp32 must match the push constant block of operation_tiled_fp32");
+
+// Storage bindings of operation.comp and operation_tiled.comp
+enum OperationBinding : uint32_t {
+	OPERATION_BINDING_A = 0, // m x k, row-major
+	OPERATION_BINDING_B = 1, // k x n, column-major
+	OPERATION_BINDING_C = 2, // m x n, row-major
+};
+
+// Specialization constants of operation_tiled.comp and its fp32 and mixed variants, by constant_id
+enum OperationTiledConstant : uint32_t {
+	OPERATION_TILED_K_SIZE = 0, // Inner dimension, 0 to read it from the push constants
+	OPERATION_TILED_TILE_K = 1, // Depth of the shared tiles along k, 8 by default
+};
+
+// Specialization constants of operation_subgroup.comp, by constant_id
+enum OperationSubgroupConstant : uint32_t {
+	OPERATION_SUBGROUP_SIZE	  = 0, // Invocations of a workgroup, the subgroup size of the device
+	OPERATION_SUBGROUP_K_SIZE = 1, // Inner dimension, 0 to read it from the push constants
+};
+
+// src/operation.comp
+inline constexpr uint32_t OPERATION_SPV[] = {
+#include "operation.spv.inc"
+};
+
+// src/operation_tiled.comp, dispatched over operation_tiled_group_count(m, n) workgroups of 16 x 16 invocations
+inline constexpr uint32_t OPERATION_TILED_SPV[] = {
+#include "operation_tiled.spv.inc"
+};
+
+// src/operation_tiled.comp compiled with -DSCALAR=float, floats in the bindings and OperationScalarsFp32, dispatched like operation_tiled
+inline constexpr uint32_t OPERATION_TILED_FP32_SPV[] = {
+#include "operation_tiled_fp32.spv.inc"
+};
+
+// src/operation_tiled.comp compiled with -DMIXED, tiles in floats, with the bindings and dispatch of operation_tiled.comp
+inline constexpr uint32_t OPERATION_TILED_MIXED_SPV[] = {
+#include "operation_tiled_mixed.spv.inc"
+};
+
+// src/operation_subgroup.comp, dispatched over operation_subgroup_group_count(m, n, subgroup_size) workgroups of a full subgroup
+inline constexpr uint32_t OPERATION_SUBGROUP_SPV[] = {
+#include "operation_subgroup.spv.inc"
+};
+
+// Rows and columns of C computed by a workgroup of operation_tiled.comp, TILE in the shader
+inline constexpr uint32_t OPERATION_TILED_TILE = 64;
+
+/**
+ * @brief Workgroups of operation_tiled.comp for an m x n C, one per tile: x along the columns, y along the rows
+ */
+inline constexpr auto operation_tiled_group_count(uint32_t m, uint32_t n) -> CulkanGroupCount {
+	return CulkanGroupCount{
+	    (n + OPERATION_TILED_TILE - 1) / OPERATION_TILED_TILE,
+	    (m + OPERATION_TILED_TILE - 1) / OPERATION_TILED_TILE,
+	    1,
+	};
+}
+
+// Columns of C computed by a subgroup of operation_subgroup.comp, COLUMNS in the shader, and rows computed by each of its lanes, REG
+inline constexpr uint32_t OPERATION_SUBGROUP_COLUMNS = 8;
+inline constexpr uint32_t OPERATION_SUBGROUP_REG     = 4;
+
+/**
+ * @brief Workgroups of operation_subgroup.comp for an m x n C, of subgroup_size invocations: x along the columns, y along the rows
+ */
+inline constexpr auto operation_subgroup_group_count(uint32_t m, uint32_t n, uint32_t subgroup_size) -> CulkanGroupCount {
+	uint32_t rows = OPERATION_SUBGROUP_REG * subgroup_size;
+	return CulkanGroupCount{
+	    (n + OPERATION_SUBGROUP_COLUMNS - 1) / OPERATION_SUBGROUP_COLUMNS,
+	    (m + rows - 1) / rows,
+	    1,
+	};
+}
+
+/**
+ * @brief Shared memory of a workgroup of operation_subgroup.comp, its block of A: REG * subgroup_size rows of DEPTH + 1 doubles
+ */
+inline constexpr auto operation_subgroup_shared_bytes(uint32_t subgroup_size) -> uint32_t {
+	return OPERATION_SUBGROUP_REG * subgroup_size * (subgroup_size / OPERATION_SUBGROUP_COLUMNS + 1) * uint32_t(sizeof(double));
+}
+
+/**
+ * @brief Precision of the products of a variant of the GPU product
+ */
+enum class GpuPrecision {
+	Double, // Same rounding as the CPU kernels, up to the order of the sums
+	Mixed,	// A and B rounded to floats and multiplied in floats, the sums and C in doubles
+	Single, // A, B, C, alpha and beta rounded to floats
+};
+
+/**
+ * @brief Shaders of the product, the same C = (beta + alpha * A * B) .* C on the same bindings
+ */
+enum class OperationVariant {
+	Tiled,	  // operation_tiled.comp
+	Subgroup, // operation_subgroup.comp, B shared by subgroup shuffles
+	Mixed,	  // operation_tiled.comp with tiles in floats
+	Fp32,	  // operation_tiled.comp with floats in the bindings
+};
+
+struct OperationVariantInfo {
+	OperationVariant variant;
+	std::string_view name;	// Name in the benchmark results and in TOP_GPU_VARIANT
+	GpuPrecision precision;
+	uint32_t const* spirv;
+	size_t spirv_size;	// Bytes
+};
+
+constexpr OperationVariantInfo OPERATION_VARIANTS[] = {
+    {OperationVariant::Tiled, "tiled", GpuPrecision::Double, OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV)},
+    {OperationVariant::Subgroup, "subgroup", GpuPrecision::Double, OPERATION_SUBGROUP_SPV, sizeof(OPERATION_SUBGROUP_SPV)},
+    {OperationVariant::Mixed, "mixed", GpuPrecision::Mixed, OPERATION_TILED_MIXED_SPV, sizeof(OPERATION_TILED_MIXED_SPV)},
+    {OperationVariant::Fp32, "fp32", GpuPrecision::Single, OPERATION_TILED_FP32_SPV, sizeof(OPERATION_TILED_FP32_SPV)},
+};
+
+inline auto operation_variant_info(OperationVariant variant) -> OperationVariantInfo const& {
+	for (auto const& info : OPERATION_VARIANTS) {
+		if (info.variant == variant) {
+			return info;
+		}
+	}
+	std::abort();
+}
+
+inline auto operation_variant_from_name(std::string_view name) -> std::optional<OperationVariant> {
+	for (auto const& info : OPERATION_VARIANTS) {
+		if (info.name == name) {
+			return info.variant;
+		}
+	}
+	return std::nullopt;
+}
+
+/**
+ * @brief Whether a device, given by culkanGetDeviceFeatures(), can run a variant.
+ * Every variant but fp32 needs doubles, and the subgroup one shuffles of doubles on full subgroups of a power of two of at least
+ * OPERATION_SUBGROUP_COLUMNS lanes, and the shared memory of its block of A.
+ */
+inline constexpr auto operation_variant_supported(CulkanDeviceFeatures const& features, OperationVariant variant) -> bool {
+	switch (variant) {
+		case OperationVariant::Fp32:
+			return true;
+		case OperationVariant::Subgroup: {
+			uint32_t lanes = features.subgroupSize;
+			return features.shaderFloat64 && features.subgroupShuffle && features.fullSubgroups &&
+			       lanes >= OPERATION_SUBGROUP_COLUMNS && (lanes & (lanes - 1)) == 0 &&
+			       operation_subgroup_shared_bytes(lanes) <= features.sharedMemorySize;
+		}
+		default:
+			return features.shaderFloat64 != 0;
+	}
+}
+
+/**
+ * @brief Variant of the product for a precision that every device with its features runs, the tiled shader at double
+ * precision. Whether the subgroup variant is faster depends on the device, which GpuProductCache::default_variant() times.
+ * Devices without doubles only run the fp32 variant, whatever the precision.
+ */
+inline constexpr auto best_operation_variant(CulkanDeviceFeatures const& features, GpuPrecision precision) -> OperationVariant {
+	if (!features.shaderFloat64 || precision == GpuPrecision::Single) {
+		return OperationVariant::Fp32;
+	}
+	if (precision == GpuPrecision::Mixed) {
+		return OperationVariant::Mixed;
+	}
+	return OperationVariant::Tiled;
+}
+
+#endif
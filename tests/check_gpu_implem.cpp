@@ -5,11 +5,483 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "matrix_product.hpp"
 #include <Kokkos_Core.hpp>
 
 #include "culkan.h"
+#include "matrix_product_gpu.hpp"
+#include "shaders.hpp"
+
+/**
+ * @brief A compute shader of the product, with the workgroup size it was compiled for and its dispatch grid
+ */
+struct Shader {
+	char const* name;
+	uint32_t const* spirv;
+	size_t spirv_size;
+	CulkanInvocations invocations;
+	CulkanGroupCount (*group_count)(uint32_t m, uint32_t n);
+	bool specialize_k; // Whether k is a specialization constant of the pipeline (operation_tiled.comp)
+};
+
+const Shader SHADERS[] = {
+    {"operation", OPERATION_SPV, sizeof(OPERATION_SPV), {1024, 1, 1}, [](uint32_t, uint32_t) { return CulkanGroupCount{1, 1, 1}; }, false},
+    {"operation_tiled", OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV), {16, 16, 1}, operation_tiled_group_count, false},
+    {"operation_tiled, k specialized", OPERATION_TILED_SPV, sizeof(OPERATION_TILED_SPV), {16, 16, 1}, operation_tiled_group_count, true},
+};
+
+/**
+ * @brief Runs the product on the GPU and compares it with the reference result
+ * @return whether they match
+ */
+auto check_gpu(Shader const& shader, double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C,
+	       RightMatrix const& C_ref) -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	CulkanBinding bindings[] = {
+	    // Binding for A
+	    {.size = m * k * sizeof(double), .type = STORAGE_BUFFER},
+	    // Binding for B
+	    {.size = k * n * sizeof(double), .type = STORAGE_BUFFER},
+	    // Binding for C
+	    {.size = m * n * sizeof(double), .type = STORAGE_BUFFER},
+	};
+	// By constant_id, OPERATION_TILED_K_SIZE then OPERATION_TILED_TILE_K
+	uint32_t constants[] = {uint32_t(k), 8};
+
+	CulkanLayout layout = {
+	    .bindingCount		 = 3,
+	    .bindings			 = bindings,
+	    .pushConstantSize		 = sizeof(OperationScalars),
+	    .specializationConstants	 = shader.specialize_k ? constants : nullptr,
+	    .specializationConstantCount = shader.specialize_k ? 2U : 0U,
+	    .requiredSubgroupSize	 = 0,
+	};
+
+	// The shader is compiled at build time and embedded in the binary
+	Culkan* culkan = culkanInitFromMemory(&layout, shader.spirv, shader.spirv_size, shader.invocations);
+	culkanWriteBinding(culkan, OPERATION_BINDING_A, A.data());
+	culkanWriteBinding(culkan, OPERATION_BINDING_B, B.data());
+
+	culkanSetup(culkan);
+	culkanSetGroupCount(culkan, shader.group_count(m, n));
+
+	// Pushed after the setup, so that the first run records the command buffer again
+	OperationScalars scalars = {.m = uint32_t(m), .n = uint32_t(n), .k = uint32_t(k), .row_offset = 0, .alpha = alpha, .beta = beta};
+	culkanSetPushConstants(culkan, &scalars);
+
+	// Run twice on the same instance, synchronously then asynchronously, the second run reuses the fence of the first one
+	auto C_gpu = RightMatrix("C_gpu", m, n);
+	for (int run = 0; run < 2; run++) {
+		culkanWriteBinding(culkan, OPERATION_BINDING_C, C.data());
+
+		// Do the GPU computation
+		if (run == 0) {
+			culkanRun(culkan);
+		}
+		else {
+			CulkanSubmission submission = culkanSubmit(culkan);
+			while (!culkanIsComplete(submission)) {
+			}
+			culkanWait(submission);
+		}
+
+		// Read the result straight from the mapped memory of C
+		culkanInvalidateBinding(culkan, OPERATION_BINDING_C);
+		memcpy(C_gpu.data(), culkanGetBindingPointer(culkan, OPERATION_BINDING_C), m * n * sizeof(double));
+
+		if (!matrix_are_equal(C_gpu, C_ref)) {
+			fmt::print("{} {}x{}x{}: GPU result differs from the reference on run {}\n", shader.name, m, n, k, run);
+			culkanDestroy(culkan);
+			return false;
+		}
+	}
+
+	culkanDestroy(culkan);
+	return true;
+}
+
+/**
+ * @brief Chains the two shaders on a shared context in a single submission: operation computes C once,
+ * its C is copied into the C of operation_tiled, which applies the product again
+ * @return whether the result matches C_ref2, the reference applied twice
+ */
+auto check_sequence(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref2)
+    -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	CulkanBinding bindings[] = {
+	    {.size = m * k * sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = k * n * sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = m * n * sizeof(double), .type = STORAGE_BUFFER},
+	};
+	CulkanLayout layout = {
+	    .bindingCount		 = 3,
+	    .bindings			 = bindings,
+	    .pushConstantSize		 = sizeof(OperationScalars),
+	    .specializationConstants	 = nullptr,
+	    .specializationConstantCount = 0,
+	    .requiredSubgroupSize	 = 0,
+	};
+	OperationScalars scalars = {.m = uint32_t(m), .n = uint32_t(n), .k = uint32_t(k), .row_offset = 0, .alpha = alpha, .beta = beta};
+
+	CulkanContext* context = culkanCreateContext();
+	Culkan* stages[2];
+	for (int i = 0; i < 2; i++) {
+		Shader const& shader = SHADERS[i];
+		stages[i]	     = culkanInitWithContext(context, &layout, shader.spirv, shader.spirv_size, shader.invocations);
+		culkanWriteBinding(stages[i], OPERATION_BINDING_A, A.data());
+		culkanWriteBinding(stages[i], OPERATION_BINDING_B, B.data());
+		culkanSetup(stages[i]);
+		culkanSetGroupCount(stages[i], shader.group_count(m, n));
+		culkanSetPushConstants(stages[i], &scalars);
+	}
+
+	// A dispatch outside the recording is refused, and records nothing
+	bool matches		 = true;
+	CulkanSequence* sequence = culkanCreateSequence(context);
+	if (culkanSequenceDispatch(sequence, stages[0]).ckResult != NOT_RECORDING) {
+		fmt::print("sequence {}x{}x{}: dispatch accepted while the sequence is not recording\n", m, n, k);
+		matches = false;
+	}
+	culkanBeginSequence(sequence);
+	culkanSequenceDispatch(sequence, stages[0]);
+	culkanSequenceBarrier(sequence);
+	culkanSequenceCopyBinding(sequence, stages[0], OPERATION_BINDING_C, stages[1], OPERATION_BINDING_C);
+	culkanSequenceBarrier(sequence);
+	culkanSequenceDispatch(sequence, stages[1]);
+	culkanEndSequence(sequence);
+
+	// Submitted twice, the second time without recording it again
+	auto C_gpu = RightMatrix("C_gpu", m, n);
+	for (int run = 0; run < 2 && matches; run++) {
+		culkanWriteBinding(stages[0], OPERATION_BINDING_C, C.data());
+		culkanWait(culkanSubmitSequence(sequence));
+		culkanReadBinding(stages[1], OPERATION_BINDING_C, C_gpu.data());
+		if (!matrix_are_equal(C_gpu, C_ref2)) {
+			fmt::print("sequence {}x{}x{}: GPU result differs from the reference on run {}\n", m, n, k, run);
+			matches = false;
+		}
+	}
+
+	// The two dispatches and the copy are timed, if the queue writes timestamps
+	CulkanStageTimes times;
+	if (matches && culkanGetSequenceTimes(sequence, &times) &&
+	    (times.commands[CULKAN_STAGE_COMPUTE] != 2 || times.commands[CULKAN_STAGE_COPY] != 1)) {
+		fmt::print("sequence {}x{}x{}: {} dispatches and {} copies timed instead of 2 and 1\n",
+			   m,
+			   n,
+			   k,
+			   times.commands[CULKAN_STAGE_COMPUTE],
+			   times.commands[CULKAN_STAGE_COPY]);
+		matches = false;
+	}
+
+	culkanDestroySequence(sequence);
+	culkanDestroy(stages[0]);
+	culkanDestroy(stages[1]);
+	culkanDestroyContext(context);
+	return matches;
+}
+
+/**
+ * @brief Sets the tiled shader up with bindings of a single double, then resizes them to the shape of the product, twice
+ * @return whether the results match the reference, and the second resize reused the memory pool instead of growing it
+ */
+auto check_resized(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref)
+    -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	CulkanBinding bindings[] = {
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = sizeof(double), .type = STORAGE_BUFFER},
+	};
+	CulkanLayout layout = {
+	    .bindingCount		 = 3,
+	    .bindings			 = bindings,
+	    .pushConstantSize		 = sizeof(OperationScalars),
+	    .specializationConstants	 = nullptr,
+	    .specializationConstantCount = 0,
+	    .requiredSubgroupSize	 = 0,
+	};
+	OperationScalars scalars = {.m = uint32_t(m), .n = uint32_t(n), .k = uint32_t(k), .row_offset = 0, .alpha = alpha, .beta = beta};
+
+	Shader const& shader = SHADERS[1];
+	Culkan* culkan	     = culkanInitFromMemory(&layout, shader.spirv, shader.spirv_size, shader.invocations);
+	culkanSetup(culkan);
+	culkanSetGroupCount(culkan, shader.group_count(m, n));
+	culkanSetPushConstants(culkan, &scalars);
+
+	bool matches	     = true;
+	uint32_t block_count = 0;
+	auto C_gpu	     = RightMatrix("C_gpu", m, n);
+	size_t sizes[]	     = {size_t(m) * k * sizeof(double), size_t(k) * n * sizeof(double), size_t(m) * n * sizeof(double)};
+	for (int resize = 0; resize < 2 && matches; resize++) {
+		for (uint32_t binding = 0; binding < 3; binding++) {
+			culkanResizeBinding(culkan, binding, sizes[binding]);
+		}
+		culkanWriteBinding(culkan, OPERATION_BINDING_A, A.data());
+		culkanWriteBinding(culkan, OPERATION_BINDING_B, B.data());
+		culkanWriteBinding(culkan, OPERATION_BINDING_C, C.data());
+		culkanRun(culkan);
+		culkanReadBinding(culkan, OPERATION_BINDING_C, C_gpu.data());
+		if (!matrix_are_equal(C_gpu, C_ref)) {
+			fmt::print("resized {}x{}x{}: GPU result differs from the reference after resize {}\n", m, n, k, resize);
+			matches = false;
+		}
+
+		// The memory freed by the first resize is reused by the second one
+		CulkanMemoryPoolStats stats = culkanGetMemoryPoolStats(culkanGetContext(culkan));
+		if (resize == 1 && stats.blockCount != block_count) {
+			fmt::print("resized {}x{}x{}: {} memory blocks after the second resize instead of {}\n",
+				   m,
+				   n,
+				   k,
+				   stats.blockCount,
+				   block_count);
+			matches = false;
+		}
+		block_count = stats.blockCount;
+	}
+
+	culkanDestroy(culkan);
+	return matches;
+}
+
+/**
+ * @brief Runs the tiled shader on host matrices imported as its bindings after its setup, or copied to them without the import
+ * @return whether the result matches the reference, read in place when C was imported
+ */
+auto check_imported(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref)
+    -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	CulkanBinding bindings[] = {
+	    {.size = m * k * sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = k * n * sizeof(double), .type = STORAGE_BUFFER},
+	    {.size = m * n * sizeof(double), .type = STORAGE_BUFFER},
+	};
+	CulkanLayout layout = {
+	    .bindingCount		 = 3,
+	    .bindings			 = bindings,
+	    .pushConstantSize		 = sizeof(OperationScalars),
+	    .specializationConstants	 = nullptr,
+	    .specializationConstantCount = 0,
+	    .requiredSubgroupSize	 = 0,
+	};
+	OperationScalars scalars = {.m = uint32_t(m), .n = uint32_t(n), .k = uint32_t(k), .row_offset = 0, .alpha = alpha, .beta = beta};
+
+	Shader const& shader = SHADERS[1];
+	Culkan* culkan	     = culkanInitFromMemory(&layout, shader.spirv, shader.spirv_size, shader.invocations);
+	culkanSetup(culkan);
+	culkanSetGroupCount(culkan, shader.group_count(m, n));
+	culkanSetPushConstants(culkan, &scalars);
+
+	// Imported after the setup, so that the descriptor set is updated and the command buffer recorded again
+	size_t alignment = culkanGetHostImportAlignment(culkanGetContext(culkan));
+	ImportableMatrix<RightMatrix> A_host(m, k, alignment);
+	ImportableMatrix<LeftMatrix> B_host(k, n, alignment);
+	ImportableMatrix<RightMatrix> C_host(m, n, alignment);
+	Kokkos::deep_copy(A_host.view, A);
+	Kokkos::deep_copy(B_host.view, B);
+	int imported = culkanImportBinding(culkan, OPERATION_BINDING_A, A_host.view.data()) +
+		       culkanImportBinding(culkan, OPERATION_BINDING_B, B_host.view.data()) +
+		       culkanImportBinding(culkan, OPERATION_BINDING_C, C_host.view.data());
+	if (alignment != 0 && imported != 3) {
+		fmt::print("imported {}x{}x{}: {} of the 3 bindings imported\n", m, n, k, imported);
+		culkanDestroy(culkan);
+		return false;
+	}
+
+	// The writes and the read copy nothing for the imported bindings, and copy as before for the others
+	bool matches = true;
+	for (int run = 0; run < 2 && matches; run++) {
+		Kokkos::deep_copy(C_host.view, C);
+		culkanWriteBinding(culkan, OPERATION_BINDING_A, A_host.view.data());
+		culkanWriteBinding(culkan, OPERATION_BINDING_B, B_host.view.data());
+		culkanWriteBinding(culkan, OPERATION_BINDING_C, C_host.view.data());
+		culkanRun(culkan);
+		culkanReadBinding(culkan, OPERATION_BINDING_C, C_host.view.data());
+		if (!matrix_are_equal(C_host.view, C_ref)) {
+			fmt::print("imported {}x{}x{}: GPU result differs from the reference on run {}\n", m, n, k, run);
+			matches = false;
+		}
+	}
+
+	culkanDestroy(culkan);
+	return matches;
+}
+
+/**
+ * @brief Runs the streamed product with panels of a few rows, so that the last panel is shorter and the slots are reused,
+ * with the uploads overlapping the dispatches and serialized on the device
+ * @return whether the result matches the reference, on two products with the same instance
+ */
+auto check_streamed(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref)
+    -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	struct {
+		int panel_rows;
+		int slots;
+		bool overlap;
+	} const configurations[] = {{1, 2, true}, {16, 2, true}, {16, 3, true}, {16, 2, false}};
+	for (auto const& configuration : configurations) {
+		GpuStreamedProduct product(m, n, k, configuration.panel_rows, configuration.slots, configuration.overlap);
+		auto C_gpu = RightMatrix("C_gpu", m, n);
+		for (int run = 0; run < 2; run++) {
+			Kokkos::deep_copy(C_gpu, C);
+			product.run(alpha, A, B, beta, C_gpu);
+			if (!matrix_are_equal(C_gpu, C_ref)) {
+				fmt::print("streamed {}x{}x{}, {} panels of {} rows, {} slots{}: GPU result differs on run {}\n",
+					   m,
+					   n,
+					   k,
+					   product.panel_count(),
+					   product.rows(),
+					   configuration.slots,
+					   configuration.overlap ? "" : " serialized",
+					   run);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Runs matrix_product_gpu() on the matrices in the layouts of the shader, then on copies in the other layouts
+ * @return whether both results match the reference, and the second call reused the plan of the first one
+ */
+auto check_function(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref)
+    -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	// A context of its own, created with the current environment
+	gpu_product_cache().clear();
+
+	auto C_gpu = RightMatrix("C_gpu", m, n);
+	Kokkos::deep_copy(C_gpu, C);
+	matrix_product_gpu(alpha, A, B, beta, C_gpu);
+	bool matches = matrix_are_equal(C_gpu, C_ref);
+	if (!matches) {
+		fmt::print("function {}x{}x{}: GPU result differs from the reference\n", m, n, k);
+	}
+
+	auto A_left  = LeftMatrix("A_left", m, k);
+	auto B_right = RightMatrix("B_right", k, n);
+	auto C_left  = LeftMatrix("C_left", m, n);
+	Kokkos::deep_copy(A_left, A);
+	Kokkos::deep_copy(B_right, B);
+	Kokkos::deep_copy(C_left, C);
+	matrix_product_gpu(alpha, A_left, B_right, beta, C_left);
+	if (matches && !matrix_are_equal(C_left, C_ref)) {
+		fmt::print("function {}x{}x{}: GPU result differs from the reference with transposed layouts\n", m, n, k);
+		matches = false;
+	}
+	if (matches && gpu_product_cache().size() != 1) {
+		fmt::print("function {}x{}x{}: {} plans cached for a single shape\n", m, n, k, gpu_product_cache().size());
+		matches = false;
+	}
+	size_t bytes = (size_t(m) * k + size_t(k) * n + size_t(m) * n) * sizeof(double);
+	if (matches && gpu_product_cache().bytes() != bytes) {
+		fmt::print("function {}x{}x{}: {} bytes of plans cached, not {}\n", m, n, k, gpu_product_cache().bytes(), bytes);
+		matches = false;
+	}
+
+	gpu_product_cache().clear();
+	return matches;
+}
+
+/**
+ * @brief Runs matrix_product_gpu() with each variant of the shader that the device supports.
+ * The double precision ones must match the reference, and the mixed and fp32 ones be within the rounding of floats.
+ * @return whether all of them match, and the variant chosen for the device is one that it supports
+ */
+auto check_variants(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref)
+    -> bool {
+	int m = int(C.extent(0));
+	int n = int(C.extent(1));
+	int k = int(A.extent(1));
+
+	gpu_product_cache().clear();
+	CulkanDeviceFeatures features = culkanGetDeviceFeatures(gpu_product_cache().get_context());
+	bool matches		      = operation_variant_supported(features, gpu_product_cache().default_variant());
+	if (!matches) {
+		fmt::print("variants: the default variant is not supported by the device\n");
+	}
+
+	auto C_gpu = RightMatrix("C_gpu", m, n);
+	for (auto const& info : OPERATION_VARIANTS) {
+		if (!matches || !operation_variant_supported(features, info.variant)) {
+			continue;
+		}
+		Kokkos::deep_copy(C_gpu, C);
+		matrix_product_gpu(alpha, A, B, beta, C_gpu, info.variant);
+		bool equal = info.precision == GpuPrecision::Double ? matrix_are_equal(C_gpu, C_ref)
+								     : matrix_compare(C_gpu, C_ref, 1e-4, 1e-4).mismatches == 0;
+		if (!equal) {
+			fmt::print("variant {} {}x{}x{}: GPU result differs from the reference\n", info.name, m, n, k);
+			matches = false;
+		}
+	}
+
+	gpu_product_cache().clear();
+	return matches;
+}
+
+/**
+ * @brief Checks every shader, their chaining, the streamed product, resized bindings and matrix_product_gpu() with each variant
+ * against the reference, with the buffers of the driver's choice, then with device local buffers behind staging copies even on
+ * unified memory, and the import of host matrices with and without it
+ */
+auto check_shaders(double alpha, RightMatrix const& A, LeftMatrix const& B, double beta, RightMatrix const& C, RightMatrix const& C_ref)
+    -> bool {
+	// The reference applied a second time, to check the chained shaders
+	auto C_ref2 = RightMatrix("C_ref2", C.extent(0), C.extent(1));
+	Kokkos::deep_copy(C_ref2, C_ref);
+	matrix_product_reference(alpha, A, B, beta, C_ref2);
+
+	for (char const* force_staging : {"0", "1"}) {
+		setenv("CULKAN_FORCE_STAGING", force_staging, 1);
+		for (auto const& shader : SHADERS) {
+			if (!check_gpu(shader, alpha, A, B, beta, C, C_ref)) {
+				return false;
+			}
+		}
+		if (!check_sequence(alpha, A, B, beta, C, C_ref2) || !check_streamed(alpha, A, B, beta, C, C_ref) ||
+		    !check_resized(alpha, A, B, beta, C, C_ref) || !check_function(alpha, A, B, beta, C, C_ref) ||
+		    !check_variants(alpha, A, B, beta, C, C_ref)) {
+			return false;
+		}
+	}
+	unsetenv("CULKAN_FORCE_STAGING");
+
+	// Host matrices imported as bindings when the device supports it, then copied with the import disabled
+	for (char const* host_import : {"1", "0"}) {
+		setenv("CULKAN_HOST_IMPORT", host_import, 1);
+		if (!check_imported(alpha, A, B, beta, C, C_ref)) {
+			return false;
+		}
+	}
+	unsetenv("CULKAN_HOST_IMPORT");
+	return true;
+}
 
 auto main(int argc, char* argv[]) -> int {
 	Kokkos::initialize(argc, argv);
@@ -65,67 +537,39 @@ auto main(int argc, char* argv[]) -> int {
 	double alpha = 2.0;
 	double beta  = -1.0;
 
-	CulkanBinding bindings[] = {
-	    // Binding for n
-	    {.size = sizeof(int), .type = UNIFORM_BUFFER},
-	    // Binding for m
-	    {.size = sizeof(int), .type = UNIFORM_BUFFER},
-	    // Binding for k
-	    {.size = sizeof(int), .type = UNIFORM_BUFFER},
-	    // Binding for A
-	    {.size = m * k * sizeof(double), .type = STORAGE_BUFFER},
-	    // Binding for B
-	    {.size = k * n * sizeof(double), .type = STORAGE_BUFFER},
-	    // Binding for C
-	    {.size = m * n * sizeof(double), .type = STORAGE_BUFFER},
-	    // Binding for alpha
-	    {.size = sizeof(double), .type = UNIFORM_BUFFER},
-	    // Binding for beta
-	    {.size = sizeof(double), .type = UNIFORM_BUFFER},
-	};
-	CulkanLayout layout = {.bindingCount = 8, .bindings = bindings};
+	// Do the CPU computation, on a copy since C is the input of the GPU runs
+	auto C = RightMatrix("C", m, n);
+	Kokkos::deep_copy(C, C_ref);
+	matrix_product_reference(alpha, A, B, beta, C_ref);
 
-	// Compile the shader
-	int ret = system("glslc ./src/operation.comp -o ./build/operation.spv");
-	if (ret != 0) {
-		fprintf(stderr, "Failed to compile shader\n");
+	if (!check_shaders(alpha, A, B, beta, C, C_ref)) {
 		return 1;
 	}
 
-	Culkan* culkan = culkanInit(&layout, "./build/operation.spv", (CulkanInvocations){1024, 1, 1});
-	culkanWriteBinding(culkan, 0, &n);
-	culkanWriteBinding(culkan, 1, &m);
-	culkanWriteBinding(culkan, 2, &k);
-	culkanWriteBinding(culkan, 3, A.data());
-	culkanWriteBinding(culkan, 4, B.data());
-	culkanWriteBinding(culkan, 5, C_ref.data());
-	culkanWriteBinding(culkan, 6, &alpha);
-	culkanWriteBinding(culkan, 7, &beta);
-
-	culkanSetup(culkan);
-
-	// Do the GPU computation
-	culkanRun(culkan);
-	double* result = (double*)malloc(m * n * sizeof(double));
-	culkanReadBinding(culkan, 5, result);
+	// Random matrices whose sizes are not multiples of the tiles of operation_tiled.comp, with several tiles along k
+	{
+		srand48(42);
+		int m = 70;
+		int n = 130;
+		int k = 37;
+		auto A = RightMatrix("A", m, k);
+		auto B = LeftMatrix("B", k, n);
+		auto C = RightMatrix("C", m, n);
+		matrix_init(A);
+		matrix_init(B);
+		matrix_init(C);
+		double alpha = drand48();
+		double beta  = drand48();
 
-	// Do the CPU computation
-	matrix_product_reference(alpha, A, B, beta, C_ref);
-
-	for (int i = 0; i < m; i++) {
-		for (int j = 0; j < n; j++) {
-			if (result[i * n + j] != C_ref(i, j)) {
-				fmt::print("Mismatch at ({}, {}): {} != {}\n", i, j, result[i * n + j], C_ref(i, j));
-				free(result);
-				culkanDestroy(culkan);
-				return 1;
-			}
+		auto C_ref = RightMatrix("C_ref", m, n);
+		Kokkos::deep_copy(C_ref, C);
+		matrix_product_reference(alpha, A, B, beta, C_ref);
+		if (!check_shaders(alpha, A, B, beta, C, C_ref)) {
+			return 1;
 		}
 	}
 
 	fmt::print("GPU result matches reference result!\n");
-	free(result);
-	culkanDestroy(culkan);
 
 	Kokkos::finalize();
 	exit(EXIT_SUCCESS);
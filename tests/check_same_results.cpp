@@ -4,6 +4,7 @@
  */
 
 #include "matrix_product.hpp"
+#include "matrix_product_cblas.hpp"
 
 #include <Kokkos_Core.hpp>
 #include <cstdlib>
@@ -114,6 +115,32 @@ auto main(int argc, char* argv[]) -> int {
 		}
 	}
 
+	// Large magnitude values should be compared relatively, not with an absolute epsilon
+	{
+		auto A = RightMatrix("A", 3, 4);
+		auto B = LeftMatrix("B", 3, 4);
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 4; j++) {
+				A(i, j) = 1e12 * (i + j + 1);
+				B(i, j) = A(i, j) * (1.0 + 1e-14);
+			}
+		}
+		if (!matrix_are_equal(A, B)) {
+			fmt::println("{}Test failed for large magnitude comparison!{}", RED, RESET);
+			Kokkos::finalize();
+			exit(EXIT_FAILURE);
+		}
+
+		// A single element off by a relative 1e-6 must be the only one reported
+		B(1, 2)		= A(1, 2) * (1.0 + 1e-6);
+		auto comparison = matrix_compare(A, B);
+		if (comparison.mismatches != 1 || comparison.max_rel_error < 1e-7 || comparison.max_ulp_distance == 0) {
+			fmt::println("{}Test failed for mismatch count!{}", RED, RESET);
+			Kokkos::finalize();
+			exit(EXIT_FAILURE);
+		}
+	}
+
 	// 100 randomised tests
 	for (int i = 0; i < 100; i++) {
 
@@ -127,26 +154,31 @@ auto main(int argc, char* argv[]) -> int {
 		double beta  = static_cast<double>(rand()) / RAND_MAX;
 
 		// Random matrices
-		auto A		= RightMatrix("A", m, k);
-		auto B		= LeftMatrix("B", k, n);
-		auto C_ref	= RightMatrix("C_ref", m, n);
-		auto C_test_i	= RightMatrix("C_test_i", m, n);
-		auto C_test_ij	= RightMatrix("C_test_ij", m, n);
-		auto C_test_ijk = RightMatrix("C_test_ijk", m, n);
+		auto A		  = RightMatrix("A", m, k);
+		auto B		  = LeftMatrix("B", k, n);
+		auto C_ref	  = RightMatrix("C_ref", m, n);
+		auto C_test_i	  = RightMatrix("C_test_i", m, n);
+		auto C_test_ij	  = RightMatrix("C_test_ij", m, n);
+		auto C_test_ijk	  = RightMatrix("C_test_ijk", m, n);
+		auto C_test_tiles = RightMatrix("C_test_tiles", m, n);
 		matrix_init(A);
 		matrix_init(B);
 		matrix_init(C_ref);
 		for (int j = 0; j < m; j++) {
 			for (int l = 0; l < n; l++) {
-				C_test_i(j, l)	 = C_ref(j, l);
-				C_test_ij(j, l)	 = C_ref(j, l);
-				C_test_ijk(j, l) = C_ref(j, l);
+				C_test_i(j, l)	   = C_ref(j, l);
+				C_test_ij(j, l)	   = C_ref(j, l);
+				C_test_ijk(j, l)   = C_ref(j, l);
+				C_test_tiles(j, l) = C_ref(j, l);
 			}
 		}
 
 		// Random cache block sizes
 		int block_size = rand() % 50 + 1;
 
+		// Random tile sizes
+		TileSizes tiles = {rand() % 50 + 1, rand() % 50 + 1, rand() % 50 + 1};
+
 		// Run the reference and test functions
 		Kokkos::fence();
 		matrix_product_reference(alpha, A, B, beta, C_ref);
@@ -155,6 +187,8 @@ auto main(int argc, char* argv[]) -> int {
 		Kokkos::fence();
 		matrix_product_cache_blocked_ij(alpha, A, B, beta, C_test_ij, block_size);
 		Kokkos::fence();
+		matrix_product_cache_blocked_tiles(alpha, A, B, beta, C_test_tiles, tiles);
+		Kokkos::fence();
 
 		// Check if the results are equal
 		if (!matrix_are_equal(C_ref, C_test_i)) {
@@ -167,7 +201,94 @@ auto main(int argc, char* argv[]) -> int {
 			Kokkos::finalize();
 			exit(EXIT_FAILURE);
 		}
+		if (!matrix_are_equal(C_ref, C_test_tiles)) {
+			fmt::println("{}Test failed for tiles {}x{}x{}!{}", RED, tiles.mc, tiles.nc, tiles.kc, RESET);
+			Kokkos::finalize();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	// Padded leading dimensions, including sizes where the padding adds a cache line
+	for (int size : {7, 8, 63, 64, 65, 128}) {
+		double alpha = static_cast<double>(rand()) / RAND_MAX;
+		double beta  = static_cast<double>(rand()) / RAND_MAX;
+
+		auto A		= RightMatrix("A", size, size + 1);
+		auto B		= LeftMatrix("B", size + 1, size);
+		auto C_ref	= RightMatrix("C_ref", size, size);
+		auto A_padded	= padded_right_matrix("A_padded", size, size + 1);
+		auto B_padded	= padded_left_matrix("B_padded", size + 1, size);
+		auto C_test_i	= padded_right_matrix("C_test_i", size, size);
+		auto C_test_ij	= padded_right_matrix("C_test_ij", size, size);
+		auto C_test_ijk = padded_right_matrix("C_test_ijk", size, size);
+		matrix_init(A);
+		matrix_init(B);
+		matrix_init(C_ref);
+		Kokkos::deep_copy(A_padded, A);
+		Kokkos::deep_copy(B_padded, B);
+		Kokkos::deep_copy(C_test_i, C_ref);
+		Kokkos::deep_copy(C_test_ij, C_ref);
+		Kokkos::deep_copy(C_test_ijk, C_ref);
+
+		Kokkos::fence();
+		matrix_product_reference(alpha, A, B, beta, C_ref);
+		Kokkos::fence();
+		matrix_product_cache_blocked_i(alpha, A_padded, B_padded, beta, C_test_i, 16);
+		Kokkos::fence();
+		matrix_product_cache_blocked_ij(alpha, A_padded, B_padded, beta, C_test_ij, 16);
+		Kokkos::fence();
+		matrix_product_cache_blocked_ijk(alpha, A_padded, B_padded, beta, C_test_ijk, 16);
+		Kokkos::fence();
+
+		if (!matrix_are_equal(C_ref, C_test_i) || !matrix_are_equal(C_ref, C_test_ij) || !matrix_are_equal(C_ref, C_test_ijk)) {
+			fmt::println("{}Test failed for padded matrices of size {}!{}", RED, size, RESET);
+			Kokkos::finalize();
+			exit(EXIT_FAILURE);
+		}
+	}
+
+#ifdef TOP_HAVE_CBLAS
+	// Vendor BLAS, with every layout of A and B
+	for (int i = 0; i < 20; i++) {
+		int m = rand() % 50 + 1;
+		int n = rand() % 50 + 1;
+		int k = rand() % 50 + 1;
+
+		double alpha = static_cast<double>(rand()) / RAND_MAX;
+		double beta  = static_cast<double>(rand()) / RAND_MAX;
+
+		auto A_right	= RightMatrix("A_right", m, k);
+		auto A_left	= LeftMatrix("A_left", m, k);
+		auto B_right	= RightMatrix("B_right", k, n);
+		auto B_left	= LeftMatrix("B_left", k, n);
+		auto C_ref	= RightMatrix("C_ref", m, n);
+		auto C_test_rl	= RightMatrix("C_test_rl", m, n);
+		auto C_test_lr	= RightMatrix("C_test_lr", m, n);
+		auto C_test_pad = padded_left_matrix("C_test_pad", m, n);
+		matrix_init(A_right);
+		matrix_init(B_left);
+		matrix_init(C_ref);
+		Kokkos::deep_copy(A_left, A_right);
+		Kokkos::deep_copy(B_right, B_left);
+		Kokkos::deep_copy(C_test_rl, C_ref);
+		Kokkos::deep_copy(C_test_lr, C_ref);
+		Kokkos::deep_copy(C_test_pad, C_ref);
+
+		Kokkos::fence();
+		matrix_product_reference(alpha, A_right, B_left, beta, C_ref);
+		Kokkos::fence();
+		matrix_product_cblas(alpha, A_right, B_left, beta, C_test_rl);
+		matrix_product_cblas(alpha, A_left, B_right, beta, C_test_lr);
+		matrix_product_cblas(alpha, A_right, B_left, beta, C_test_pad);
+		Kokkos::fence();
+
+		if (!matrix_are_equal(C_ref, C_test_rl) || !matrix_are_equal(C_ref, C_test_lr) || !matrix_are_equal(C_ref, C_test_pad)) {
+			fmt::println("{}Test failed for cblas!{}", RED, RESET);
+			Kokkos::finalize();
+			exit(EXIT_FAILURE);
+		}
 	}
+#endif
 
 	// Print that everything is ok
 	Kokkos::finalize();
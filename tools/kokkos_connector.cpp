@@ -0,0 +1,203 @@
+/**
+ * @file tools/kokkos_connector.cpp
+ * @brief Kokkos Tools connector aggregating the time and number of calls of each kernel label, and the allocation high-water mark
+ * of each memory space.
+ *
+ * It is loaded by Kokkos at initialization:
+ *   KOKKOS_TOOLS_LIBS=./build/tools/libtop.kokkos_connector.so ./build/benchmarks/top.bench
+ * The summary is printed at Kokkos::finalize, on stderr or in the file given by TOP_KOKKOS_CONNECTOR_OUTPUT.
+ *
+ * The hooks only do a hash lookup and read the clock, so it can stay enabled in production runs.
+ * Like Kokkos itself, it expects kernels to be launched from a single host thread. Views can be allocated inside kernels, so the
+ * allocation hooks run on several threads at once, and the memory spaces are guarded by a mutex.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Memory space of an allocation, as passed by Kokkos
+ */
+struct SpaceHandle {
+	char name[64];
+};
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct KernelStats {
+	std::string label;
+	const char* type; // parallel_for, parallel_reduce or parallel_scan
+	uint64_t calls	   = 0;
+	double total_time  = 0.0;
+	double min_time	   = 0.0;
+	double max_time	   = 0.0;
+};
+
+struct SpaceStats {
+	std::string name;
+	uint64_t allocations = 0;
+	uint64_t current     = 0; // Bytes currently allocated
+	uint64_t high_water  = 0; // Maximum of current
+};
+
+// Lookup of the labels without building a std::string on every kernel launch
+struct LabelHash {
+	using is_transparent = void;
+	auto operator()(std::string_view label) const -> size_t {
+		return std::hash<std::string_view>{}(label);
+	}
+};
+
+struct Connector {
+	std::unordered_map<std::string, uint64_t, LabelHash, std::equal_to<>> kernel_ids;
+	std::vector<KernelStats> kernels;
+	std::vector<Clock::time_point> starts; // Stack of the start times of the running kernels
+	std::vector<SpaceStats> spaces; // Guarded by spaces_mutex, with the counters of each space
+	std::mutex spaces_mutex;
+	Clock::time_point init_time;
+};
+
+Connector* connector = nullptr;
+
+auto begin_kernel(const char* name, const char* type, uint64_t* kID) -> void {
+	auto it = connector->kernel_ids.find(std::string_view(name));
+	if (it == connector->kernel_ids.end()) {
+		it = connector->kernel_ids.emplace(name, connector->kernels.size()).first;
+		connector->kernels.push_back(KernelStats{.label = name, .type = type});
+	}
+	*kID = it->second;
+	connector->starts.push_back(Clock::now());
+}
+
+auto end_kernel(uint64_t kID) -> void {
+	std::chrono::duration<double> elapsed = Clock::now() - connector->starts.back();
+	connector->starts.pop_back();
+
+	auto& stats    = connector->kernels[kID];
+	double seconds = elapsed.count();
+	stats.min_time = stats.calls == 0 ? seconds : std::min(stats.min_time, seconds);
+	stats.max_time = std::max(stats.max_time, seconds);
+	stats.total_time += seconds;
+	stats.calls++;
+}
+
+/**
+ * @brief Stats of a memory space, added on its first allocation. spaces_mutex must be held while using them.
+ */
+auto space_stats(SpaceHandle const& space) -> SpaceStats& {
+	for (auto& stats : connector->spaces) {
+		if (stats.name == space.name) {
+			return stats;
+		}
+	}
+	connector->spaces.push_back(SpaceStats{.name = space.name});
+	return connector->spaces.back();
+}
+
+auto print_summary(FILE* out) -> void {
+	std::chrono::duration<double> total = Clock::now() - connector->init_time;
+
+	std::vector<KernelStats const*> sorted;
+	for (auto const& stats : connector->kernels) {
+		sorted.push_back(&stats);
+	}
+	std::sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) { return a->total_time > b->total_time; });
+
+	fprintf(out, "Kokkos connector: %.6fs between initialize and finalize\n", total.count());
+	fprintf(out,
+		"%-50s %-16s %10s %14s %14s %14s %14s %7s\n",
+		"Label",
+		"Type",
+		"Calls",
+		"Total (s)",
+		"Mean (s)",
+		"Min (s)",
+		"Max (s)",
+		"% time");
+	for (auto* stats : sorted) {
+		fprintf(out,
+			"%-50s %-16s %10lu %14.6f %14.6f %14.6f %14.6f %7.2f\n",
+			stats->label.c_str(),
+			stats->type,
+			stats->calls,
+			stats->total_time,
+			stats->total_time / double(stats->calls),
+			stats->min_time,
+			stats->max_time,
+			100.0 * stats->total_time / total.count());
+	}
+
+	fprintf(out, "%-50s %12s %16s %16s\n", "Memory space", "Allocations", "High-water (B)", "Live at end (B)");
+	for (auto const& stats : connector->spaces) {
+		fprintf(out, "%-50s %12lu %16lu %16lu\n", stats.name.c_str(), stats.allocations, stats.high_water, stats.current);
+	}
+}
+
+} // namespace
+
+extern "C" void kokkosp_init_library(const int /*loadSeq*/, const uint64_t /*interfaceVer*/, const uint32_t /*devInfoCount*/,
+				     void* /*deviceInfo*/) {
+	connector	     = new Connector();
+	connector->init_time = Clock::now();
+}
+
+extern "C" void kokkosp_finalize_library() {
+	const char* path = std::getenv("TOP_KOKKOS_CONNECTOR_OUTPUT");
+	FILE* out	 = path != nullptr ? fopen(path, "w") : nullptr;
+	print_summary(out != nullptr ? out : stderr);
+	if (out != nullptr) {
+		fclose(out);
+	}
+	delete connector;
+	connector = nullptr;
+}
+
+extern "C" void kokkosp_begin_parallel_for(const char* name, const uint32_t /*devID*/, uint64_t* kID) {
+	begin_kernel(name, "parallel_for", kID);
+}
+
+extern "C" void kokkosp_end_parallel_for(const uint64_t kID) {
+	end_kernel(kID);
+}
+
+extern "C" void kokkosp_begin_parallel_reduce(const char* name, const uint32_t /*devID*/, uint64_t* kID) {
+	begin_kernel(name, "parallel_reduce", kID);
+}
+
+extern "C" void kokkosp_end_parallel_reduce(const uint64_t kID) {
+	end_kernel(kID);
+}
+
+extern "C" void kokkosp_begin_parallel_scan(const char* name, const uint32_t /*devID*/, uint64_t* kID) {
+	begin_kernel(name, "parallel_scan", kID);
+}
+
+extern "C" void kokkosp_end_parallel_scan(const uint64_t kID) {
+	end_kernel(kID);
+}
+
+extern "C" void kokkosp_allocate_data(const SpaceHandle space, const char* /*label*/, const void* const /*ptr*/, const uint64_t size) {
+	std::lock_guard lock(connector->spaces_mutex);
+	auto& stats = space_stats(space);
+	stats.allocations++;
+	stats.current += size;
+	stats.high_water = std::max(stats.high_water, stats.current);
+}
+
+extern "C" void kokkosp_deallocate_data(const SpaceHandle space, const char* /*label*/, const void* const /*ptr*/, const uint64_t size) {
+	std::lock_guard lock(connector->spaces_mutex);
+	auto& stats   = space_stats(space);
+	stats.current = size > stats.current ? 0 : stats.current - size;
+}